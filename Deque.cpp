@@ -2,13 +2,36 @@
 #include <iterator>
 #include <vector>
 #include <cassert>
+#include <algorithm>
 
+//elements per block of a Deque<T>: as many as fit in BLOCK_BYTES, rounded down to a power of two
+//so that iterator arithmetic is shifts and masks, but never fewer than MIN_BLOCK_SIZE for large T
 template <typename T>
+constexpr size_t deque_block_size() {
+    const size_t BLOCK_BYTES = 4096;
+    const size_t MIN_BLOCK_SIZE = 16;
+
+    size_t size = MIN_BLOCK_SIZE;
+    while (size * 2 * sizeof(T) <= BLOCK_BYTES) {
+        size *= 2;
+    }
+    return size;
+}
+
+template <typename T, size_t BlockSize = deque_block_size<T>()>
 class Deque {
+    static_assert(BlockSize > 0, "block can not be empty");
 
 private:
-    static const size_t BLOCK_SIZE = 8;
+    static const size_t BLOCK_SIZE = BlockSize;
     static const size_t DEFAULT_CAPACITY = 32;
+    static const size_t MIN_BLOCKS = 4;
+    static const size_t SPARE_BLOCKS = 2;
+
+    //how many block pointers to reserve up front for that many elements
+    static size_t blocks_for(size_t elements) {
+        return std::max(elements / BLOCK_SIZE, size_t(MIN_BLOCKS));
+    }
 
     struct PtrDeque {
         //both ways expanding array of T*
@@ -21,6 +44,20 @@ private:
         size_t size_;
 
         void reallocate() {
+            if (size_ * 3 <= capacity) {
+                //a queue drifts towards one end while its size stays put, so it is moved back
+                //to the middle instead of growing forever
+                size_t new_idx_begin = (capacity - size_) / 2;
+                if (new_idx_begin < idx_begin) {
+                    std::copy(buffer + idx_begin, buffer + idx_begin + size_, buffer + new_idx_begin);
+                } else {
+                    std::copy_backward(buffer + idx_begin, buffer + idx_begin + size_,
+                                       buffer + new_idx_begin + size_);
+                }
+                idx_begin = new_idx_begin;
+                return;
+            }
+
             V* new_buffer = new V[capacity * 3];
             size_t new_idx_begin = capacity + (capacity - size_) / 2;
             for (size_t i = 0; i < size_; ++i) {
@@ -42,7 +79,7 @@ private:
             std::swap(size_, that.size_);
         }
 
-        explicit PtrDeque(size_t cap = DEFAULT_CAPACITY / BLOCK_SIZE) :
+        explicit PtrDeque(size_t cap = blocks_for(DEFAULT_CAPACITY)) :
                 buffer(new V[cap]), idx_begin(cap / 2), capacity(cap),
                 size_(0) {}
 
@@ -130,7 +167,7 @@ private:
 
         TemplateIterator& operator=(const TemplateIterator& that) {
             TemplateIterator tmp(that);
-            this->swap(that);
+            this->swap(tmp);
             return *this;
         }
 
@@ -222,27 +259,64 @@ private:
         }
     };
 
+    //emptied blocks are kept here and handed out again, so a deque used as a queue
+    //stops allocating once it reaches its steady size
+    T* allocate_block() {
+        if (spare_count > 0) {
+            return spare[--spare_count];
+        }
+        return reinterpret_cast<T*>(new uint8_t[BLOCK_SIZE * sizeof(T)]);
+    }
+
+    void release_block(T* block) {
+        if (spare_count < SPARE_BLOCKS) {
+            spare[spare_count++] = block;
+            return;
+        }
+        delete[] reinterpret_cast<uint8_t*>(block);
+    }
+
+    void free_spare_blocks() {
+        while (spare_count > 0) {
+            delete[] reinterpret_cast<uint8_t*>(spare[--spare_count]);
+        }
+    }
+
     void add_block_back() {
-        external.push_back(reinterpret_cast<T*>(new uint8_t[BLOCK_SIZE * sizeof(T)]));
+        T* block = allocate_block();
+        try {
+            external.push_back(block);
+        } catch (...) {
+            release_block(block);
+            throw;
+        }
     }
 
     void add_block_front() {
-        external.push_front(reinterpret_cast<T*>(new uint8_t[BLOCK_SIZE * sizeof(T)]));
+        T* block = allocate_block();
+        try {
+            external.push_front(block);
+        } catch (...) {
+            release_block(block);
+            throw;
+        }
     }
 
     void delete_block_back() {
-        delete[] reinterpret_cast<uint8_t*>(external.back());
+        release_block(external.back());
         external.pop_back();
     }
 
     void delete_block_front() {
-        delete[] reinterpret_cast<uint8_t*>(external.front());
+        release_block(external.front());
         external.pop_front();
     }//adding and deleting blocks
 
     PtrDeque external;
     TemplateIterator<false> begin_;
     size_t size_;
+    T* spare[SPARE_BLOCKS];
+    size_t spare_count = 0;
 
 public:
     //    mutable std::vector<std::string> loger;
@@ -331,7 +405,7 @@ public:
         }
     }
 
-    Deque() : external(DEFAULT_CAPACITY / BLOCK_SIZE), begin_(nullptr, 0), size_(0) {
+    Deque() : external(blocks_for(DEFAULT_CAPACITY)), begin_(nullptr, 0), size_(0) {
         //loger.push_back("default c-tor");
     }
 
@@ -349,7 +423,7 @@ public:
 
 
     explicit Deque(size_t sz, const T& elem = T()) :
-            external(std::max(3 * sz, size_t(DEFAULT_CAPACITY)) / BLOCK_SIZE), begin_(nullptr, 0), size_(0) {
+            external(blocks_for(std::max(3 * sz, size_t(DEFAULT_CAPACITY)))), begin_(nullptr, 0), size_(0) {
         //loger.push_back("size_t c-tor");
         try {
             for (size_t i = 0; i < sz; ++i) {
@@ -365,6 +439,7 @@ public:
         //loger.push_back("d-tor");
         //        std::cerr << loger.size() << "\n";
         clear();
+        free_spare_blocks();
     }
 
     void swap(Deque& that) {
@@ -373,6 +448,8 @@ public:
         external.swap(that.external);
         begin_.swap(that.begin_);
         std::swap(size_, that.size_);
+        std::swap(spare, that.spare);
+        std::swap(spare_count, that.spare_count);
     }
 
     Deque& operator=(const Deque& that) {
@@ -419,11 +496,12 @@ public:
         return (*this)[idx];
     }
 
-    void push_back(const T& elem) {
-        //loger.push_back("push_back");
+    template <typename ... Args>
+    void emplace_back(Args&& ... args) {
+        //loger.push_back("emplace_back");
 
         if (size_ == 0) {
-            push_front(elem);
+            emplace_front(std::forward<Args>(args)...);
             return;
         }
 
@@ -433,7 +511,7 @@ public:
         }
 
         try {
-            new(&(*end())) T(elem);
+            new(&(*end())) T(std::forward<Args>(args)...);
         } catch (...) {
             if (end().block_pos == 0)
                 delete_block_back();
@@ -461,16 +539,20 @@ public:
         --size_;
     }
 
-    void push_front(const T& elem) {
-        //loger.push_back("push_front");
+    void push_back(const T& elem) {
+        emplace_back(elem);
+    }
 
-        if (size_ == 0) {
-            add_block_front();
-            begin_.ptr_to_block_ptr = &(external[0]);
-            begin_.block_pos = BLOCK_SIZE;
-        }
+    void push_back(T&& elem) {
+        emplace_back(std::move(elem));
+    }
 
-        if (begin_.block_pos == 0) {
+    template <typename ... Args>
+    void emplace_front(Args&& ... args) {
+        //loger.push_back("emplace_front");
+
+        bool new_block = (size_ == 0 || begin_.block_pos == 0);
+        if (new_block) {
             add_block_front();
             begin_.block_pos = BLOCK_SIZE - 1;
             begin_.ptr_to_block_ptr = &(external[0]);
@@ -479,19 +561,28 @@ public:
         }
 
         try {
-            new(&(*begin())) T(elem);
+            new(&(*begin())) T(std::forward<Args>(args)...);
         } catch (...) {
-            if (begin_.block_pos == BLOCK_SIZE - 1) {
+            if (new_block) {
                 delete_block_front();
-                //TODO:begin_.block_pos = -1;
+                begin_.block_pos = 0;
+                begin_.ptr_to_block_ptr = size_ == 0 ? nullptr : &(external[0]);
+            } else {
+                ++(begin_.block_pos);
             }
-            ++(begin_.block_pos);
-            begin_.ptr_to_block_ptr = &(external[0]);
             throw;
         }
         ++size_;
     }
 
+    void push_front(const T& elem) {
+        emplace_front(elem);
+    }
+
+    void push_front(T&& elem) {
+        emplace_front(std::move(elem));
+    }
+
     void pop_front() {
         //loger.push_back("pop_front");
 
@@ -510,44 +601,111 @@ public:
         ++begin_;
     }
 
-    void insert(const iterator insert_it, const T& elem) {
-        //loger.push_back("insert");
+    //new elements are appended at the end nearer to pos and rotated into place, so only
+    //min(i, n - i) old elements move; if constructing one throws, the deque is left as it was
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    void insert(const iterator insert_it, InputIt first, InputIt last) {
+        //loger.push_back("insert range");
 
-        if (size() == 0) {
-            push_back(elem);
-            return;
+        size_t idx = insert_it - begin();
+        size_t old_size = size_;
+        bool at_front = idx < old_size - idx;
+
+        size_t added = 0;
+        try {
+            for (; first != last; ++first, ++added) {
+                if (at_front) {
+                    emplace_front(*first);
+                } else {
+                    emplace_back(*first);
+                }
+            }
+        } catch (...) {
+            for (; added > 0; --added) {
+                if (at_front) {
+                    pop_front();
+                } else {
+                    pop_back();
+                }
+            }
+            throw;
+        }
+
+        if (at_front) {
+            std::reverse(begin(), begin() + added);
+            std::rotate(begin(), begin() + added, begin() + added + idx);
+        } else {
+            std::rotate(begin() + idx, begin() + old_size, end());
         }
+    }
+
+    void insert(const iterator insert_it, size_t count, const T& elem) {
+        //loger.push_back("insert count");
 
-        Deque<T> backup(*this);
-        iterator backup_it = backup.begin() + (insert_it - (this->begin()));
+        size_t idx = insert_it - begin();
+        size_t old_size = size_;
+        bool at_front = idx < old_size - idx;
 
+        //pushing does not move existing elements, so elem stays valid even if it is one of them
+        size_t added = 0;
+        try {
+            for (; added < count; ++added) {
+                if (at_front) {
+                    push_front(elem);
+                } else {
+                    push_back(elem);
+                }
+            }
+        } catch (...) {
+            for (; added > 0; --added) {
+                if (at_front) {
+                    pop_front();
+                } else {
+                    pop_back();
+                }
+            }
+            throw;
+        }
 
-        T tmp = *(--(backup.end()));
-        for (iterator it = (--(backup.end())); it != backup_it; --it) {
-            *(it) = *(it - 1);
+        if (at_front) {
+            std::rotate(begin(), begin() + count, begin() + count + idx);
+        } else {
+            std::rotate(begin() + idx, begin() + old_size, end());
         }
-        *(backup_it) = elem;
-        backup.push_back(tmp);
+    }
 
-        *this = backup;
+    void insert(const iterator insert_it, const T& elem) {
+        //loger.push_back("insert");
+
+        insert(insert_it, 1, elem);
     }
 
-    void erase(const iterator& erase_it) {
-        //loger.push_back("erase");
+    //the shorter side is moved over the gap and the now unused end is popped
+    void erase(const iterator& first, const iterator& last) {
+        //loger.push_back("erase range");
 
-        if (size_ == 1) {
-            pop_back();
+        size_t idx = first - begin();
+        size_t count = last - first;
+        if (count == 0) {
             return;
         }
 
-        Deque<T> backup(*this);
-        iterator backup_it = backup.begin() + (erase_it - (this->begin()));
-
-        for (iterator it(backup_it); it != backup.end() - 1; ++it) {
-            *(it) = *(it + 1);
+        if (idx < size_ - idx - count) {
+            std::move_backward(begin(), begin() + idx, begin() + idx + count);
+            for (size_t i = 0; i < count; ++i) {
+                pop_front();
+            }
+        } else {
+            std::move(begin() + idx + count, end(), begin() + idx);
+            for (size_t i = 0; i < count; ++i) {
+                pop_back();
+            }
         }
-        backup.pop_back();
+    }
+
+    void erase(const iterator& erase_it) {
+        //loger.push_back("erase");
 
-        *this = backup;
+        erase(erase_it, erase_it + 1);
     }
 };
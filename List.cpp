@@ -1,22 +1,142 @@
 #include <iterator>
 #include <vector>
 #include <cstddef>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <initializer_list>
+#include <tuple>
+#include <cstdint>
 
 template <size_t cap>
 class alignas(std::max_align_t) StackStorage {
 private:
+    //overflow goes to heap chunks, each twice as big as the previous one
+    struct alignas(std::max_align_t) HeapChunk {
+        HeapChunk* prev;
+        size_t capacity;
+
+        uint8_t* data() {
+            return reinterpret_cast<uint8_t*>(this + 1);
+        }
+    };
+
+    static constexpr size_t MIN_CHUNK_SIZE = 1024;
+
     uint8_t pool[cap];
-    size_t sz = 0;
+    size_t sz = 0;//offset inside the current chunk
+    HeapChunk* chunk = nullptr;//current chunk, nullptr while still in pool
+
+    size_t used = 0;
+    size_t peak = 0;
+    size_t reserved = cap;
+    size_t heapChunks = 0;
+
+    uint8_t* chunkBegin() {
+        return chunk ? chunk->data() : pool;
+    }
+
+    size_t chunkCapacity() const {
+        return chunk ? chunk->capacity : cap;
+    }
+
+    void addChunk(size_t atLeast) {
+        size_t capacity = std::max({2 * chunkCapacity(), MIN_CHUNK_SIZE, atLeast});
+        auto newChunk = static_cast<HeapChunk*>(::operator new(sizeof(HeapChunk) + capacity));
+        newChunk->prev = chunk;
+        newChunk->capacity = capacity;
+        chunk = newChunk;
+        sz = 0;
+        reserved += capacity;
+        ++heapChunks;
+    }
+
+    void popChunk() {
+        HeapChunk* prev = chunk->prev;
+        reserved -= chunk->capacity;
+        --heapChunks;
+        ::operator delete(chunk);
+        chunk = prev;
+    }
+
 public:
+    struct Mark {
+        HeapChunk* chunk;
+        size_t sz;
+        size_t used;
+    };
+
+    struct Stats {
+        size_t used;//bytes handed out, alignment padding included
+        size_t peak;
+        size_t reserved;//pool plus heap chunks
+        size_t heapChunks;
+    };
+
+    //everything allocated during the lifetime of a Scope is released at its end
+    class Scope {
+        StackStorage& storage;
+        Mark mark;
+    public:
+        explicit Scope(StackStorage& storage) : storage(storage), mark(storage.mark()) {}
+
+        Scope(const Scope&) = delete;
+
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            storage.rewind(mark);
+        }
+    };
+
+    StackStorage() = default;
+
+    StackStorage(const StackStorage&) = delete;
+
+    StackStorage& operator=(const StackStorage&) = delete;
+
+    ~StackStorage() {
+        reset();
+    }
+
     void* alloc(size_t toAlloc, size_t allignment = 1) {
-        sz = sz + (allignment - (sz % allignment)) % allignment;//upper bound of (sz/alignment)
-        if (toAlloc + sz > cap)
-            return nullptr;
-        void* beginPtr = pool + sz;
-        sz = toAlloc + sz;
+        auto begin = reinterpret_cast<uintptr_t>(chunkBegin());
+        size_t alignedSz = (begin + sz + allignment - 1) / allignment * allignment - begin;
+        if (toAlloc + alignedSz > chunkCapacity()) {
+            addChunk(toAlloc + allignment);
+            begin = reinterpret_cast<uintptr_t>(chunkBegin());
+            alignedSz = (begin + allignment - 1) / allignment * allignment - begin;
+        }
+
+        void* beginPtr = chunkBegin() + alignedSz;
+        used += toAlloc + alignedSz - sz;
+        peak = std::max(peak, used);
+        sz = toAlloc + alignedSz;
         return beginPtr;
     }
 
+    Mark mark() const {
+        return {chunk, sz, used};
+    }
+
+    void rewind(const Mark& mark) {
+        while (chunk != mark.chunk) {
+            popChunk();
+        }
+        sz = mark.sz;
+        used = mark.used;
+    }
+
+    void reset() {
+        rewind({nullptr, 0, 0});
+    }
+
+    Stats stats() const {
+        return {used, peak, reserved, heapChunks};
+    }
+
     bool operator==(const StackStorage& that) {
         return that.pool == pool;
     }
@@ -26,173 +146,2328 @@ public:
 template <typename T, size_t cap>
 class StackAllocator {
 public:
-    StackStorage<cap>& stack;
+    //a pointer rather than a reference, so the allocator can be reassigned and swapped together with containers
+    StackStorage<cap>* stack;
 
-    explicit StackAllocator(StackStorage<cap>& storage) : stack(storage) {}
+    explicit StackAllocator(StackStorage<cap>& storage) : stack(&storage) {}
 
     StackAllocator() = delete;
 
+    StackAllocator(const StackAllocator& that) = default;
+
     template <typename U>
     StackAllocator(const StackAllocator<U, cap>& that) : stack(that.stack) {}
 
-    StackAllocator& operator=(const StackAllocator& that) {
-        stack = that.stack;
+    StackAllocator& operator=(const StackAllocator& that) = default;
+
+    ~StackAllocator() = default;
+
+
+    T* allocate(size_t toAlloc) {
+        return reinterpret_cast<T*>(stack->alloc(sizeof(T) * toAlloc, alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    //one contiguous piece, deallocate is a no-op anyway so objects in it may be freed one by one
+    void allocate_batch(T** out, size_t cnt) {
+        T* first = allocate(cnt);
+        for (size_t i = 0; i < cnt; ++i) {
+            out[i] = first + i;
+        }
+    }
+
+    using value_type = T;
+
+    //memory belongs to the storage, so containers moved or swapped may take the allocator along
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = StackAllocator<U, cap>;
+    };
+
+    template <typename U>
+    bool operator==(const StackAllocator<U, cap>& that) const {
+        return stack == that.stack;
+    }
+
+    template <typename U>
+    bool operator!=(const StackAllocator<U, cap>& that) const {
+        return stack != that.stack;
+    }
+};
+
+//fixed-size blocks with a free list per block size, memory goes back to the pool on deallocate
+class PoolStorage {
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FixedPool {
+        size_t blockSize;
+        FreeBlock* freeList = nullptr;
+        size_t nextChunkBlocks = FIRST_CHUNK_BLOCKS;
+    };
+
+    static constexpr size_t FIRST_CHUNK_BLOCKS = 32;
+    static constexpr size_t MAX_CHUNK_BLOCKS = 4096;
+
+    std::vector<FixedPool> pools;
+    std::vector<void*> chunks;
+
+    static size_t blockSizeFor(size_t toAlloc, size_t allignment) {
+        size_t step = std::max(allignment, alignof(FreeBlock));
+        return (std::max(toAlloc, sizeof(FreeBlock)) + step - 1) / step * step;
+    }
+
+    FixedPool& poolFor(size_t blockSize) {
+        for (FixedPool& pool : pools) {
+            if (pool.blockSize == blockSize)
+                return pool;
+        }
+        pools.push_back(FixedPool{blockSize});
+        return pools.back();
+    }
+
+    void grow(FixedPool& pool, size_t minBlocks = 0) {
+        size_t blockCnt = std::max(pool.nextChunkBlocks, minBlocks);
+        auto chunk = static_cast<uint8_t*>(::operator new(pool.blockSize * blockCnt));
+        chunks.push_back(chunk);
+        for (size_t i = blockCnt; i > 0; --i) {
+            auto block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * pool.blockSize);
+            block->next = pool.freeList;
+            pool.freeList = block;
+        }
+        pool.nextChunkBlocks = std::min(2 * pool.nextChunkBlocks, MAX_CHUNK_BLOCKS);
+    }
+
+public:
+    PoolStorage() = default;
+
+    PoolStorage(const PoolStorage&) = delete;
+
+    PoolStorage& operator=(const PoolStorage&) = delete;
+
+    ~PoolStorage() {
+        for (void* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* alloc(size_t toAlloc, size_t allignment = 1) {
+        if (allignment > alignof(std::max_align_t))
+            return ::operator new(toAlloc, std::align_val_t(allignment));
+
+        FixedPool& pool = poolFor(blockSizeFor(toAlloc, allignment));
+        if (!pool.freeList) {
+            grow(pool);
+        }
+        FreeBlock* block = pool.freeList;
+        pool.freeList = block->next;
+        return block;
+    }
+
+    //cnt blocks at once, a chunk grown here holds the whole rest of the batch at consecutive addresses
+    void allocBatch(size_t toAlloc, size_t allignment, size_t cnt, void** out) {
+        if (allignment > alignof(std::max_align_t)) {
+            for (size_t i = 0; i < cnt; ++i) {
+                out[i] = alloc(toAlloc, allignment);
+            }
+            return;
+        }
+
+        FixedPool& pool = poolFor(blockSizeFor(toAlloc, allignment));
+        for (size_t i = 0; i < cnt; ++i) {
+            if (!pool.freeList) {
+                try {
+                    grow(pool, cnt - i);
+                }
+                catch (...) {
+                    for (size_t j = 0; j < i; ++j) {
+                        dealloc(out[j], toAlloc, allignment);
+                    }
+                    throw;
+                }
+            }
+            out[i] = pool.freeList;
+            pool.freeList = pool.freeList->next;
+        }
+    }
+
+    void dealloc(void* ptr, size_t toDealloc, size_t allignment = 1) {
+        if (allignment > alignof(std::max_align_t)) {
+            ::operator delete(ptr, std::align_val_t(allignment));
+            return;
+        }
+
+        FixedPool& pool = poolFor(blockSizeFor(toDealloc, allignment));
+        auto block = static_cast<FreeBlock*>(ptr);
+        block->next = pool.freeList;
+        pool.freeList = block;
+    }
+};
+
+
+template <typename T>
+class PoolAllocator {
+    template <typename U>
+    friend
+    class PoolAllocator;
+
+private:
+    //shared by all copies and rebinds, so nodes may be freed through any of them
+    std::shared_ptr<PoolStorage> storage;
+
+public:
+    PoolAllocator() : storage(std::make_shared<PoolStorage>()) {}
+
+    PoolAllocator(const PoolAllocator& that) = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& that) : storage(that.storage) {}
+
+    PoolAllocator& operator=(const PoolAllocator& that) = default;
+
+    ~PoolAllocator() = default;
+
+
+    T* allocate(size_t toAlloc) {
+        //arrays (e.g. bucket vectors) are not pooled, only single nodes are
+        if (toAlloc != 1)
+            return static_cast<T*>(::operator new(sizeof(T) * toAlloc, std::align_val_t(alignof(T))));
+        return reinterpret_cast<T*>(storage->alloc(sizeof(T), alignof(T)));
+    }
+
+    //cnt single objects, each one is freed by deallocate(ptr, 1)
+    void allocate_batch(T** out, size_t cnt) {
+        storage->allocBatch(sizeof(T), alignof(T), cnt, reinterpret_cast<void**>(out));
+    }
+
+    void deallocate(T* ptr, size_t toDealloc) {
+        if (toDealloc != 1) {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+            return;
+        }
+        storage->dealloc(ptr, sizeof(T), alignof(T));
+    }
+
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U>;
+    };
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& that) const {
+        return storage == that.storage;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& that) const {
+        return storage != that.storage;
+    }
+};
+
+//per-thread arena: allocation and same-thread frees touch only thread-owned lists,
+//blocks freed by other threads come back through a lock-free MPSC stack
+class ThreadArena {
+public:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 256;
+    static constexpr size_t CLASS_CNT = MAX_BLOCK_SIZE / GRANULARITY;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    //every block starts with its owner and size class, so any thread can route a free back to it
+    struct alignas(GRANULARITY) BlockHeader {
+        ThreadArena* owner;
+        size_t cls;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeLists[CLASS_CNT] = {};
+    std::atomic<FreeBlock*> remoteFrees{nullptr};
+    std::vector<void*> chunks;
+
+    //an arena outlives its thread: on thread exit it is parked here and adopted by the next new thread,
+    //so blocks still in use elsewhere stay valid
+    struct Abandoned {
+        std::mutex mutex;
+        std::vector<ThreadArena*> arenas;
+    };
+
+    static Abandoned& abandoned() {
+        static Abandoned list;
+        return list;
+    }
+
+    struct Holder {
+        ThreadArena* arena;
+
+        Holder() {
+            Abandoned& list = abandoned();
+            std::lock_guard<std::mutex> lock(list.mutex);
+            if (list.arenas.empty()) {
+                arena = new ThreadArena();
+            } else {
+                arena = list.arenas.back();
+                list.arenas.pop_back();
+            }
+        }
+
+        ~Holder() {
+            Abandoned& list = abandoned();
+            std::lock_guard<std::mutex> lock(list.mutex);
+            list.arenas.push_back(arena);
+        }
+    };
+
+    static size_t classOf(size_t bytes) {
+        return (std::max(bytes, size_t(1)) + GRANULARITY - 1) / GRANULARITY - 1;
+    }
+
+    static size_t slotSize(size_t cls) {
+        return sizeof(BlockHeader) + (cls + 1) * GRANULARITY;
+    }
+
+    static BlockHeader* headerOf(void* ptr) {
+        return reinterpret_cast<BlockHeader*>(ptr) - 1;
+    }
+
+    void grow(size_t cls) {
+        auto chunk = static_cast<uint8_t*>(::operator new(CHUNK_SIZE));
+        chunks.push_back(chunk);
+        size_t slot = slotSize(cls);
+        for (size_t pos = CHUNK_SIZE / slot; pos > 0; --pos) {
+            auto header = reinterpret_cast<BlockHeader*>(chunk + (pos - 1) * slot);
+            header->owner = this;
+            header->cls = cls;
+            pushLocal(reinterpret_cast<FreeBlock*>(header + 1), cls);
+        }
+    }
+
+    void pushLocal(FreeBlock* block, size_t cls) {
+        block->next = freeLists[cls];
+        freeLists[cls] = block;
+    }
+
+    //remote frees are sorted into local lists only by the owner
+    void collectRemote() {
+        FreeBlock* block = remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        while (block) {
+            FreeBlock* next = block->next;
+            pushLocal(block, headerOf(block)->cls);
+            block = next;
+        }
+    }
+
+    void pushRemote(FreeBlock* block) {
+        block->next = remoteFrees.load(std::memory_order_relaxed);
+        while (!remoteFrees.compare_exchange_weak(block->next, block,
+                                                  std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    ThreadArena() = default;
+
+public:
+    ThreadArena(const ThreadArena&) = delete;
+
+    ThreadArena& operator=(const ThreadArena&) = delete;
+
+    static ThreadArena& current() {
+        thread_local Holder holder;
+        return *holder.arena;
+    }
+
+    void* alloc(size_t toAlloc) {
+        if (toAlloc > MAX_BLOCK_SIZE) {
+            auto header = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + toAlloc));
+            header->owner = nullptr;
+            return header + 1;
+        }
+
+        size_t cls = classOf(toAlloc);
+        if (!freeLists[cls]) {
+            collectRemote();
+        }
+        if (!freeLists[cls]) {
+            grow(cls);
+        }
+        FreeBlock* block = freeLists[cls];
+        freeLists[cls] = block->next;
+        return block;
+    }
+
+    void allocBatch(size_t toAlloc, size_t cnt, void** out) {
+        if (toAlloc > MAX_BLOCK_SIZE) {
+            for (size_t i = 0; i < cnt; ++i) {
+                out[i] = alloc(toAlloc);
+            }
+            return;
+        }
+
+        size_t cls = classOf(toAlloc);
+        for (size_t i = 0; i < cnt; ++i) {
+            if (!freeLists[cls]) {
+                collectRemote();
+            }
+            if (!freeLists[cls]) {
+                try {
+                    grow(cls);
+                }
+                catch (...) {
+                    for (size_t j = 0; j < i; ++j) {
+                        pushLocal(static_cast<FreeBlock*>(out[j]), cls);
+                    }
+                    throw;
+                }
+            }
+            out[i] = freeLists[cls];
+            freeLists[cls] = freeLists[cls]->next;
+        }
+    }
+
+    void dealloc(void* ptr) {
+        BlockHeader* header = headerOf(ptr);
+        if (!header->owner) {
+            ::operator delete(header);
+            return;
+        }
+
+        auto block = static_cast<FreeBlock*>(ptr);
+        if (header->owner == this) {
+            pushLocal(block, header->cls);
+        } else {
+            header->owner->pushRemote(block);
+        }
+    }
+};
+
+
+template <typename T>
+class ThreadArenaAllocator {
+public:
+    using value_type = T;
+
+    //all state is in ThreadArena::current(), so every instance is interchangeable
+    using is_always_equal = std::true_type;
+
+    ThreadArenaAllocator() = default;
+
+    template <typename U>
+    ThreadArenaAllocator(const ThreadArenaAllocator<U>&) {}
+
+    T* allocate(size_t toAlloc) {
+        static_assert(alignof(T) <= ThreadArena::GRANULARITY, "over-aligned types are not supported");
+        return static_cast<T*>(ThreadArena::current().alloc(sizeof(T) * toAlloc));
+    }
+
+    void deallocate(T* ptr, size_t) {
+        ThreadArena::current().dealloc(ptr);
+    }
+
+    //cnt single objects, each one is freed by deallocate(ptr, 1)
+    void allocate_batch(T** out, size_t cnt) {
+        static_assert(alignof(T) <= ThreadArena::GRANULARITY, "over-aligned types are not supported");
+        ThreadArena::current().allocBatch(sizeof(T), cnt, reinterpret_cast<void**>(out));
+    }
+
+    template <typename U>
+    struct rebind {
+        using other = ThreadArenaAllocator<U>;
+    };
+
+    template <typename U>
+    bool operator==(const ThreadArenaAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ThreadArenaAllocator<U>&) const {
+        return false;
+    }
+};
+
+//links of a doubly linked ring, an unlinked hook points to itself;
+//List keeps one inside every node, IntrusiveList expects one inside the element
+struct ListHook {
+    ListHook* next = this;
+    ListHook* prev = this;
+
+    ListHook() = default;
+
+    //a copied element is not in any list, so the links are never copied
+    ListHook(const ListHook&) {}
+
+    ListHook& operator=(const ListHook&) {
         return *this;
     }
 
-    ~StackAllocator() = default;
+    void link(ListHook* that) {
+        next = that;
+        that->prev = this;
+    }
+
+    void unlink() {
+        prev->link(next);
+        next = this;
+        prev = this;
+    }
+
+    [[nodiscard]] bool isLinked() const {
+        return next != this;
+    }
+
+    void swap(ListHook& that) {
+        if (next == this && &that == that.next) {
+            return;
+        }
+        if (next != this && &that == that.next) {
+            that.link(next);
+            prev->link(&that);
+            next = this;
+            prev = this;
+            return;
+        }
+        if (next == this && &that != that.next) {
+            that.swap(*this);
+            return;
+        }
+        if (next != this && &that != that.next) {
+            ListHook tmp;
+            tmp.swap(that);
+            this->swap(that);
+            this->swap(tmp);
+            return;
+        }
+    }
+};
+
+//an allocator may offer allocate_batch(out, cnt): cnt single-object allocations in one call,
+//each of them released separately by deallocate(ptr, 1)
+template <typename Alloc, typename = void>
+struct has_allocate_batch : std::false_type {};
+
+template <typename Alloc>
+struct has_allocate_batch<Alloc, std::void_t<decltype(std::declval<Alloc&>().allocate_batch(
+        std::declval<typename Alloc::value_type**>(), size_t()))>> : std::true_type {};
+
+template <typename T, typename Allocator = std::allocator<T>>
+class List {
+    using baseNode = ListHook;
+
+    struct Node : baseNode {
+        T val;
+
+        explicit Node(const T& val) : baseNode(), val(val) {}
+
+        template <typename... Args>
+        explicit Node(Args&& ... args) : baseNode(), val(std::forward<Args>(args)...) {}
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeAllocatorTraits = std::allocator_traits<NodeAllocator>;
+    using AllocatorTraits = std::allocator_traits<Allocator>;
+
+private:
+    NodeAllocator nodeAlloc;
+    Allocator alloc;
+    size_t sz = 0;
+    baseNode fakeNode;
+
+    //takes over all nodes of that, this has to be empty
+    void steal(List& that) noexcept {
+        fakeNode.swap(that.fakeNode);
+        std::swap(sz, that.sz);
+    }
+
+    template <typename... Args>
+    Node* newNode(Args&& ... args) {
+        Node* newNode = NodeAllocatorTraits::allocate(nodeAlloc, 1);
+        try {
+            std::allocator_traits<Allocator>::construct(alloc, newNode, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            NodeAllocatorTraits::deallocate(nodeAlloc, newNode, 1);
+            throw;
+        }
+        return newNode;
+    }
+
+    void deleteNode(Node* toDel) {
+        std::allocator_traits<Allocator>::destroy(alloc, toDel);
+        NodeAllocatorTraits::deallocate(nodeAlloc, toDel, 1);
+    }
+
+    static constexpr size_t NODE_BATCH = 64;
+
+    template <typename It>
+    using RequireInputIterator = std::enable_if_t<std::is_convertible_v<
+            typename std::iterator_traits<It>::iterator_category, std::input_iterator_tag>>;
+
+    void allocateNodes(Node** out, size_t cnt) {
+        if constexpr (has_allocate_batch<NodeAllocator>::value) {
+            nodeAlloc.allocate_batch(out, cnt);
+        } else {
+            size_t done = 0;
+            try {
+                for (; done < cnt; ++done) {
+                    out[done] = NodeAllocatorTraits::allocate(nodeAlloc, 1);
+                }
+            }
+            catch (...) {
+                for (size_t i = 0; i < done; ++i) {
+                    NodeAllocatorTraits::deallocate(nodeAlloc, out[i], 1);
+                }
+                throw;
+            }
+        }
+    }
+
+    //appends cnt nodes made by construct(node) to a detached ring, taking them from the allocator in batches
+    template <typename Construct>
+    void buildChain(baseNode& chain, size_t cnt, Construct& construct) {
+        Node* nodes[NODE_BATCH];
+        while (cnt > 0) {
+            size_t batch = std::min(cnt, NODE_BATCH);
+            allocateNodes(nodes, batch);
+            size_t built = 0;
+            try {
+                for (; built < batch; ++built) {
+                    construct(nodes[built]);
+                    chain.prev->link(nodes[built]);
+                    nodes[built]->link(&chain);
+                }
+            }
+            catch (...) {
+                for (size_t i = built; i < batch; ++i) {
+                    NodeAllocatorTraits::deallocate(nodeAlloc, nodes[i], 1);
+                }
+                throw;
+            }
+            cnt -= batch;
+        }
+    }
+
+    void destroyChain(baseNode& chain) {
+        baseNode* node = chain.next;
+        while (node != &chain) {
+            baseNode* next = node->next;
+            deleteNode(static_cast<Node*>(node));
+            node = next;
+        }
+        chain.next = &chain;
+        chain.prev = &chain;
+    }
+
+    //moves [first, last) right before pos, O(1)
+    static void transfer(baseNode* pos, baseNode* first, baseNode* last) {
+        if (first == last || pos == first || pos == last)
+            return;
+        baseNode* lastIncluded = last->prev;
+        first->prev->link(last);
+        pos->prev->link(first);
+        lastIncluded->link(pos);
+    }
+
+    static const T& valOf(baseNode* node) {
+        return static_cast<Node*>(node)->val;
+    }
+
+    //merges two nullptr-terminated chains linked by next only, a goes first on equal elements
+    template <typename Compare>
+    static baseNode* mergeChains(baseNode* a, baseNode* b, Compare& comp) {
+        baseNode head;
+        baseNode* tail = &head;
+        while (a && b) {
+            if (comp(valOf(b), valOf(a))) {
+                tail->next = b;
+                b = b->next;
+            } else {
+                tail->next = a;
+                a = a->next;
+            }
+            tail = tail->next;
+        }
+        tail->next = a ? a : b;
+        return head.next;
+    }
+
+
+    template <bool isConst>
+    class TemplateIterator {
+    public:
+        baseNode* nodePtr;
+        T* valPtr;
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using reference = std::conditional_t<isConst, const T&, T&>;
+        using pointer = std::conditional_t<isConst, const T*, T*>;
+        using difference_type = std::ptrdiff_t;
+
+        TemplateIterator(baseNode* nodePtr, T* valPtr) : nodePtr(nodePtr), valPtr(valPtr) {}
+
+        TemplateIterator(const TemplateIterator& that) = default;
+
+        explicit TemplateIterator(Node* nodePtr) : TemplateIterator(static_cast<baseNode*>(nodePtr), &(nodePtr->val)) {}
+
+        operator TemplateIterator<true>() const {
+            return TemplateIterator<true>(nodePtr, valPtr);
+        }
+
+        reference operator*() const {
+            return *valPtr;
+        }
+
+        pointer operator->() const {
+            return valPtr;
+        }
+
+        TemplateIterator& operator++() {
+            nodePtr = (nodePtr->next);
+            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            return *this;
+        }
+
+        TemplateIterator operator++(int) {
+            TemplateIterator tmp(*this);
+            nodePtr = (nodePtr->next);
+            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            return tmp;
+        }
+
+        TemplateIterator& operator--() {
+            nodePtr = (nodePtr->prev);
+            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            return *this;
+        }
+
+        TemplateIterator& operator--(int) {
+            nodePtr = (nodePtr->prev);
+            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            return *this;
+        }
+
+        bool operator==(const TemplateIterator& x) const {
+            return nodePtr == x.nodePtr;
+        }
+
+        bool operator!=(const TemplateIterator& x) const {
+            return nodePtr != x.nodePtr;
+        }
+    };
+
+public:
+    using iterator = TemplateIterator<false>;
+    using const_iterator = TemplateIterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+private:
+    //build(chain) fills a detached ring and returns its length, the ring is linked in only once complete,
+    //so a throwing element leaves the list untouched
+    template <typename Build>
+    iterator insertChain(const_iterator pos, Build build) {
+        baseNode chain;
+        size_t cnt;
+        try {
+            cnt = build(chain);
+        }
+        catch (...) {
+            destroyChain(chain);
+            throw;
+        }
+        if (cnt == 0)
+            return iterator(pos.nodePtr, pos.valPtr);
+
+        baseNode* first = chain.next;
+        transfer(pos.nodePtr, first, &chain);
+        sz += cnt;
+        return iterator(static_cast<Node*>(first));
+    }
+
+public:
+    void clear() {
+        while (sz > 0) {
+            pop_back();
+        }
+    }
+
+    explicit List(size_t size, const T& val, const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {
+        insert(cend(), size, val);
+    }
+
+    explicit List(size_t size, const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {
+        auto construct = [this](Node* node) {
+            std::allocator_traits<Allocator>::construct(alloc, node);
+        };
+        insertChain(cend(), [&](baseNode& chain) {
+            buildChain(chain, size, construct);
+            return size;
+        });
+    }
+
+    template <typename InputIt, typename = RequireInputIterator<InputIt>>
+    List(InputIt first, InputIt last, const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {
+        insert(cend(), first, last);
+    }
+
+    List(std::initializer_list<T> init, const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {
+        insert(cend(), init.begin(), init.end());
+    }
+
+    explicit List(const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {}
+
+    Allocator get_allocator() const {
+        return alloc;
+    }
+
+    List(const List& that) :
+            nodeAlloc(std::allocator_traits<Allocator>::select_on_container_copy_construction(that.nodeAlloc)),
+            alloc(std::allocator_traits<Allocator>::select_on_container_copy_construction(that.alloc)) {
+        insert(cend(), that.begin(), that.end());
+    }
+
+
+    ~List() {
+        clear();
+    }
+
+    //allocators are exchanged only if they propagate on swap, otherwise they have to be equal
+    void swap(List& that) noexcept {
+        if constexpr (AllocatorTraits::propagate_on_container_swap::value) {
+            std::swap(nodeAlloc, that.nodeAlloc);
+            std::swap(alloc, that.alloc);
+        }
+        std::swap(sz, that.sz);
+        fakeNode.swap(that.fakeNode);
+    }
+
+    //the allocator is copied, not default-constructed, so allocators without a default state (StackAllocator) work
+    List(List&& that) noexcept :
+            nodeAlloc(that.nodeAlloc), alloc(that.alloc) {
+        steal(that);
+    }
+
+    //O(1) when the allocator propagates or both are equal, element-wise into our own nodes otherwise
+    List& operator=(List&& that) noexcept(AllocatorTraits::propagate_on_container_move_assignment::value ||
+                                          AllocatorTraits::is_always_equal::value) {
+        if (this == &that)
+            return *this;
+
+        if constexpr (!AllocatorTraits::propagate_on_container_move_assignment::value &&
+                      !AllocatorTraits::is_always_equal::value) {
+            if (alloc != that.alloc) {
+                assign(std::make_move_iterator(that.begin()), std::make_move_iterator(that.end()));
+                return *this;
+            }
+        }
+
+        clear();
+        if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value) {
+            nodeAlloc = that.nodeAlloc;
+            alloc = that.alloc;
+        }
+        steal(that);
+        return *this;
+    }
+
+    List& operator=(const List& that) {
+        if (this == &that)
+            return *this;
+
+        constexpr bool propagate = AllocatorTraits::propagate_on_container_copy_assignment::value;
+
+        //existing nodes are reused only when copying into them can not throw and they stay with our allocator
+        if constexpr (std::is_nothrow_copy_assignable_v<T> && std::is_nothrow_copy_constructible_v<T>) {
+            if (!propagate || alloc == that.alloc) {
+                if constexpr (propagate) {
+                    nodeAlloc = that.nodeAlloc;
+                    alloc = that.alloc;
+                }
+                assign(that.begin(), that.end());
+                return *this;
+            }
+        }
+
+        //the copy is made before our nodes are freed, so a throwing element leaves *this
+        //and its allocator untouched; our nodes go back to the allocator that made them
+        List tmp(that.begin(), that.end(), propagate ? that.alloc : alloc);
+        clear();
+        if constexpr (propagate) {
+            nodeAlloc = that.nodeAlloc;
+            alloc = that.alloc;
+        }
+        steal(tmp);
+        return *this;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return sz;
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&& ... args) {
+        Node* nodePtr = newNode(std::forward<Args>(args)...);
+        fakeNode.prev->link(nodePtr);
+        nodePtr->link(&fakeNode);
+        ++sz;
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    template <typename... Args>
+    void push_back(Args&& ... args) {
+        emplace_back(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&& ... args) {
+        Node* nodePtr = newNode(std::forward<Args>(args)...);
+        nodePtr->link(fakeNode.next);
+        fakeNode.link(nodePtr);
+        ++sz;
+    }
+
+    void push_front(const T& value) {
+        emplace_front(value);
+    }
+
+    template <typename... Args>
+    void push_front(Args&& ... args) {
+        emplace_front(std::forward<Args>(args)...);
+    }
+
+    void pop_back() {
+        Node* toDel = static_cast<Node*>(fakeNode.prev);
+        toDel->prev->link(&fakeNode);
+        deleteNode(static_cast<Node*>(toDel));
+        --sz;
+    }
+
+    void pop_front() {
+        Node* toDel = static_cast<Node*>(fakeNode.next);
+        fakeNode.link(toDel->next);
+        deleteNode(static_cast<Node*>(toDel));
+        --sz;
+    }
+
+    void insert(const_iterator it, const T& val) {
+        Node* toIns = newNode(val);
+        it.nodePtr->prev->link(toIns);
+        toIns->link(it.nodePtr);
+        ++sz;
+    }
+
+    iterator insert(const_iterator pos, size_t cnt, const T& val) {
+        auto construct = [this, &val](Node* node) {
+            std::allocator_traits<Allocator>::construct(alloc, node, val);
+        };
+        return insertChain(pos, [&](baseNode& chain) {
+            buildChain(chain, cnt, construct);
+            return cnt;
+        });
+    }
+
+    //forward ranges are counted first and allocated in batches, single-pass ones node by node
+    template <typename InputIt, typename = RequireInputIterator<InputIt>>
+    iterator insert(const_iterator pos, InputIt first, InputIt last) {
+        auto construct = [this, &first](Node* node) {
+            std::allocator_traits<Allocator>::construct(alloc, node, *first);
+            ++first;
+        };
+        return insertChain(pos, [&](baseNode& chain) {
+            if constexpr (std::is_convertible_v<typename std::iterator_traits<InputIt>::iterator_category,
+                                                std::forward_iterator_tag>) {
+                size_t cnt = std::distance(first, last);
+                buildChain(chain, cnt, construct);
+                return cnt;
+            } else {
+                size_t cnt = 0;
+                for (; first != last; ++cnt) {
+                    buildChain(chain, 1, construct);
+                }
+                return cnt;
+            }
+        });
+    }
+
+    iterator insert(const_iterator pos, std::initializer_list<T> init) {
+        return insert(pos, init.begin(), init.end());
+    }
+
+    //existing nodes are reused by assignment, only the difference is allocated or freed
+    template <typename InputIt, typename = RequireInputIterator<InputIt>>
+    void assign(InputIt first, InputIt last) {
+        size_t kept = 0;
+        for (iterator it = begin(); it != end() && first != last; ++it, ++first, ++kept) {
+            *it = *first;
+        }
+        while (sz > kept) {
+            pop_back();
+        }
+        insert(cend(), first, last);
+    }
+
+    void assign(size_t cnt, const T& val) {
+        size_t kept = 0;
+        for (iterator it = begin(); it != end() && kept < cnt; ++it, ++kept) {
+            *it = val;
+        }
+        while (sz > kept) {
+            pop_back();
+        }
+        insert(cend(), cnt - kept, val);
+    }
+
+    void assign(std::initializer_list<T> init) {
+        assign(init.begin(), init.end());
+    }
+
+    void erase(const_iterator it) {
+        Node* toDel = static_cast<Node*>(it.nodePtr);
+        toDel->prev->link(toDel->next);
+        deleteNode(toDel);
+        --sz;
+    }
+
+    //splice family only relinks nodes, so both lists have to use equal allocators
+    void splice(const_iterator pos, List& that) {
+        transfer(pos.nodePtr, that.fakeNode.next, &that.fakeNode);
+        sz += that.sz;
+        that.sz = 0;
+    }
+
+    void splice(const_iterator pos, List&& that) {
+        splice(pos, that);
+    }
+
+    void splice(const_iterator pos, List& that, const_iterator it) {
+        transfer(pos.nodePtr, it.nodePtr, it.nodePtr->next);
+        ++sz;
+        --that.sz;
+    }
+
+    void splice(const_iterator pos, List&& that, const_iterator it) {
+        splice(pos, that, it);
+    }
+
+    //O(1) inside one list, O(distance) between lists to keep size() O(1)
+    void splice(const_iterator pos, List& that, const_iterator first, const_iterator last) {
+        if (&that != this) {
+            size_t moved = std::distance(first, last);
+            sz += moved;
+            that.sz -= moved;
+        }
+        transfer(pos.nodePtr, first.nodePtr, last.nodePtr);
+    }
+
+    void splice(const_iterator pos, List&& that, const_iterator first, const_iterator last) {
+        splice(pos, that, first, last);
+    }
+
+    template <typename Compare>
+    void merge(List& that, Compare comp) {
+        if (&that == this)
+            return;
+
+        baseNode* pos = fakeNode.next;
+        while (that.fakeNode.next != &that.fakeNode) {
+            baseNode* first = that.fakeNode.next;
+            while (pos != &fakeNode && !comp(valOf(first), valOf(pos))) {
+                pos = pos->next;
+            }
+            if (pos == &fakeNode) {
+                transfer(pos, first, &that.fakeNode);
+                break;
+            }
+            baseNode* last = first->next;
+            while (last != &that.fakeNode && comp(valOf(last), valOf(pos))) {
+                last = last->next;
+            }
+            transfer(pos, first, last);
+        }
+        sz += that.sz;
+        that.sz = 0;
+    }
+
+    void merge(List& that) {
+        merge(that, std::less<>());
+    }
+
+    template <typename Compare>
+    void merge(List&& that, Compare comp) {
+        merge(that, comp);
+    }
+
+    void merge(List&& that) {
+        merge(that);
+    }
+
+    //stable bottom-up merge sort on the nodes themselves, allocates nothing
+    template <typename Compare>
+    void sort(Compare comp) {
+        if (sz < 2)
+            return;
+
+        //bins[i] is a sorted run of 2^i nodes, higher bins hold earlier nodes
+        baseNode* bins[64] = {};
+        baseNode* node = fakeNode.next;
+        while (node != &fakeNode) {
+            baseNode* next = node->next;
+            node->next = nullptr;
+            baseNode* carry = node;
+            size_t i = 0;
+            for (; bins[i]; ++i) {
+                carry = mergeChains(bins[i], carry, comp);
+                bins[i] = nullptr;
+            }
+            bins[i] = carry;
+            node = next;
+        }
+
+        baseNode* sorted = nullptr;
+        for (baseNode* bin : bins) {
+            if (bin) {
+                sorted = mergeChains(bin, sorted, comp);
+            }
+        }
+
+        baseNode* tail = &fakeNode;
+        for (; sorted; sorted = sorted->next) {
+            tail->link(sorted);
+            tail = sorted;
+        }
+        tail->link(&fakeNode);
+    }
+
+    void sort() {
+        sort(std::less<>());
+    }
+
+    void reverse() {
+        baseNode* node = &fakeNode;
+        do {
+            std::swap(node->next, node->prev);
+            node = node->prev;
+        } while (node != &fakeNode);
+    }
+
+    template <typename BinaryPredicate>
+    size_t unique(BinaryPredicate pred) {
+        size_t removed = 0;
+        baseNode* node = fakeNode.next;
+        while (node != &fakeNode && node->next != &fakeNode) {
+            baseNode* next = node->next;
+            if (pred(valOf(node), valOf(next))) {
+                node->link(next->next);
+                deleteNode(static_cast<Node*>(next));
+                --sz;
+                ++removed;
+            } else {
+                node = next;
+            }
+        }
+        return removed;
+    }
+
+    size_t unique() {
+        return unique(std::equal_to<>());
+    }
+
+
+    iterator begin() {
+        return iterator(static_cast<Node*>(fakeNode.next));
+    }
+
+    const_iterator begin() const {
+        return const_iterator(const_cast<Node*>(static_cast<const Node*>(fakeNode.next)));
+    }
+
+    iterator end() {
+        return iterator(&fakeNode, nullptr);
+    }
+
+    const_iterator end() const {
+        return const_iterator(const_cast<baseNode*>(&fakeNode), nullptr);
+    }
+
+    const_iterator cbegin() const {
+        return const_iterator(begin());
+    }
+
+    const_iterator cend() const {
+        return const_iterator(end());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator crend() const {
+        return const_reverse_iterator(begin());
+    }
+};
+
+
+//each chunk keeps up to ChunkCapacity elements in place: one allocation and two links per chunk
+//instead of per element, iteration walks arrays; insert/erase shift inside one chunk only
+template <typename T, typename Allocator = std::allocator<T>,
+        size_t ChunkCapacity = (256 / sizeof(T) > 4 ? 256 / sizeof(T) : 4)>
+class UnrolledList {
+    static_assert(ChunkCapacity >= 2, "chunk has to be splittable");
+
+    struct baseChunk {
+        baseChunk* next = this;
+        baseChunk* prev = this;
+        size_t cnt = 0;
+
+        void link(baseChunk* that) {
+            next = that;
+            that->prev = this;
+        }
+    };
+
+    struct Chunk : baseChunk {
+        alignas(T) uint8_t space[sizeof(T) * ChunkCapacity];
+
+        T* at(size_t idx) {
+            return reinterpret_cast<T*>(space) + idx;
+        }
+    };
+
+    using ChunkAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Chunk>;
+    using ChunkAllocatorTraits = std::allocator_traits<ChunkAllocator>;
+    using AllocatorTraits = std::allocator_traits<Allocator>;
+
+private:
+    ChunkAllocator chunkAlloc;
+    Allocator alloc;
+    size_t sz = 0;
+    baseChunk fakeChunk;
+
+    Chunk* newChunkAfter(baseChunk* pos) {
+        Chunk* chunk = ChunkAllocatorTraits::allocate(chunkAlloc, 1);
+        ::new(static_cast<baseChunk*>(chunk)) baseChunk();
+        chunk->link(pos->next);
+        pos->link(chunk);
+        return chunk;
+    }
+
+    void deleteChunk(Chunk* chunk) {
+        chunk->prev->link(chunk->next);
+        ChunkAllocatorTraits::deallocate(chunkAlloc, chunk, 1);
+    }
+
+    //moves the element at from to the raw slot to
+    void relocate(T* to, T* from) {
+        AllocatorTraits::construct(alloc, to, std::move_if_noexcept(*from));
+        AllocatorTraits::destroy(alloc, from);
+    }
+
+    //opens a gap at idx, chunk must not be full
+    void shiftRight(Chunk* chunk, size_t idx) {
+        for (size_t i = chunk->cnt; i > idx; --i) {
+            relocate(chunk->at(i), chunk->at(i - 1));
+        }
+    }
+
+    //closes the gap at idx
+    void shiftLeft(Chunk* chunk, size_t idx) {
+        for (size_t i = idx; i + 1 < chunk->cnt; ++i) {
+            relocate(chunk->at(i), chunk->at(i + 1));
+        }
+    }
+
+    //moves the upper half of a full chunk into a new chunk right after it
+    Chunk* split(Chunk* chunk) {
+        Chunk* upper = newChunkAfter(chunk);
+        size_t half = ChunkCapacity / 2;
+        for (size_t i = half; i < chunk->cnt; ++i) {
+            relocate(upper->at(i - half), chunk->at(i));
+        }
+        upper->cnt = chunk->cnt - half;
+        chunk->cnt = half;
+        return upper;
+    }
+
+    //moves cnt elements from the front of from to the end of to, both must fit
+    void moveFront(Chunk* to, Chunk* from, size_t cnt) {
+        for (size_t i = 0; i < cnt; ++i) {
+            relocate(to->at(to->cnt + i), from->at(i));
+        }
+        for (size_t i = cnt; i < from->cnt; ++i) {
+            relocate(from->at(i - cnt), from->at(i));
+        }
+        to->cnt += cnt;
+        from->cnt -= cnt;
+    }
+
+    //moves cnt elements from the end of from to the front of to, both must fit
+    void moveBack(Chunk* to, Chunk* from, size_t cnt) {
+        for (size_t i = to->cnt; i > 0; --i) {
+            relocate(to->at(i - 1 + cnt), to->at(i - 1));
+        }
+        for (size_t i = 0; i < cnt; ++i) {
+            relocate(to->at(i), from->at(from->cnt - cnt + i));
+        }
+        to->cnt += cnt;
+        from->cnt -= cnt;
+    }
+
+    //keeps a chunk that dropped below half full from staying that way: it is merged with a neighbour
+    //if both fit in one chunk, otherwise it takes elements over from it;
+    //returns where the element at (chunk, idx) ended up
+    std::pair<baseChunk*, size_t> rebalance(Chunk* chunk, size_t idx) {
+        if (chunk->next != &fakeChunk) {
+            auto next = static_cast<Chunk*>(chunk->next);
+            if (chunk->cnt + next->cnt <= ChunkCapacity) {
+                moveFront(chunk, next, next->cnt);
+                deleteChunk(next);
+            } else {
+                moveFront(chunk, next, (next->cnt - chunk->cnt) / 2);
+            }
+            return {chunk, idx};
+        }
+        if (chunk->prev != &fakeChunk) {
+            auto prev = static_cast<Chunk*>(chunk->prev);
+            if (chunk->cnt + prev->cnt <= ChunkCapacity) {
+                size_t offset = prev->cnt;
+                moveFront(prev, chunk, chunk->cnt);
+                deleteChunk(chunk);
+                return {prev, offset + idx};
+            }
+            size_t cnt = (prev->cnt - chunk->cnt) / 2;
+            moveBack(chunk, prev, cnt);
+            return {chunk, idx + cnt};
+        }
+        return {chunk, idx};
+    }
+
+    void swapChains(UnrolledList& that) {
+        std::swap(fakeChunk.next, that.fakeChunk.next);
+        std::swap(fakeChunk.prev, that.fakeChunk.prev);
+        for (baseChunk* fake : {&fakeChunk, &that.fakeChunk}) {
+            if (fake->next == &fakeChunk || fake->next == &that.fakeChunk) {
+                fake->next = fake->prev = fake;
+            } else {
+                fake->prev->link(fake);
+                fake->link(fake->next);
+            }
+        }
+        std::swap(sz, that.sz);
+    }
+
+    template <bool isConst>
+    class TemplateIterator {
+        friend UnrolledList;
+
+    private:
+        baseChunk* chunkPtr;
+        size_t idx;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using reference = std::conditional_t<isConst, const T&, T&>;
+        using pointer = std::conditional_t<isConst, const T*, T*>;
+        using difference_type = std::ptrdiff_t;
+
+        TemplateIterator(baseChunk* chunkPtr, size_t idx) : chunkPtr(chunkPtr), idx(idx) {}
+
+        TemplateIterator(const TemplateIterator& that) = default;
+
+        TemplateIterator& operator=(const TemplateIterator& that) = default;
+
+        operator TemplateIterator<true>() const {
+            return TemplateIterator<true>(chunkPtr, idx);
+        }
+
+        reference operator*() const {
+            return *static_cast<Chunk*>(chunkPtr)->at(idx);
+        }
+
+        pointer operator->() const {
+            return static_cast<Chunk*>(chunkPtr)->at(idx);
+        }
+
+        TemplateIterator& operator++() {
+            if (++idx == chunkPtr->cnt) {
+                chunkPtr = chunkPtr->next;
+                idx = 0;
+            }
+            return *this;
+        }
+
+        TemplateIterator operator++(int) {
+            TemplateIterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        TemplateIterator& operator--() {
+            if (idx == 0) {
+                chunkPtr = chunkPtr->prev;
+                idx = chunkPtr->cnt;
+            }
+            --idx;
+            return *this;
+        }
+
+        TemplateIterator operator--(int) {
+            TemplateIterator tmp(*this);
+            --*this;
+            return tmp;
+        }
+
+        bool operator==(const TemplateIterator& x) const {
+            return chunkPtr == x.chunkPtr && idx == x.idx;
+        }
+
+        bool operator!=(const TemplateIterator& x) const {
+            return !(*this == x);
+        }
+    };
+
+public:
+    using iterator = TemplateIterator<false>;
+    using const_iterator = TemplateIterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    explicit UnrolledList(const Allocator& allocator = Allocator()) :
+            chunkAlloc(allocator), alloc(allocator) {}
+
+    explicit UnrolledList(size_t size, const T& val, const Allocator& allocator = Allocator()) :
+            UnrolledList(allocator) {
+        try {
+            for (size_t i = 0; i < size; ++i) {
+                push_back(val);
+            }
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    UnrolledList(const UnrolledList& that) :
+            chunkAlloc(AllocatorTraits::select_on_container_copy_construction(that.alloc)),
+            alloc(AllocatorTraits::select_on_container_copy_construction(that.alloc)) {
+        try {
+            for (const T& val : that) {
+                push_back(val);
+            }
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    UnrolledList(UnrolledList&& that) noexcept : chunkAlloc(that.chunkAlloc), alloc(that.alloc) {
+        swapChains(that);
+    }
+
+    UnrolledList& operator=(const UnrolledList& that) {
+        UnrolledList tmp(that);
+        swap(tmp);
+        return *this;
+    }
+
+    UnrolledList& operator=(UnrolledList&& that) noexcept {
+        UnrolledList tmp(std::move(that));
+        swap(tmp);
+        return *this;
+    }
+
+    ~UnrolledList() {
+        clear();
+    }
+
+    void swap(UnrolledList& that) {
+        std::swap(chunkAlloc, that.chunkAlloc);
+        std::swap(alloc, that.alloc);
+        swapChains(that);
+    }
+
+    Allocator get_allocator() const {
+        return alloc;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return sz;
+    }
+
+    void clear() {
+        while (fakeChunk.next != &fakeChunk) {
+            auto chunk = static_cast<Chunk*>(fakeChunk.next);
+            for (size_t i = 0; i < chunk->cnt; ++i) {
+                AllocatorTraits::destroy(alloc, chunk->at(i));
+            }
+            deleteChunk(chunk);
+        }
+        sz = 0;
+    }
+
+    template <typename... Args>
+    iterator emplace(const_iterator it, Args&& ... args) {
+        baseChunk* pos = it.chunkPtr;
+        size_t idx = it.idx;
+
+        //appending to the previous chunk avoids shifting when inserting at a chunk boundary
+        if (idx == 0 && pos->prev != &fakeChunk && pos->prev->cnt < ChunkCapacity) {
+            pos = pos->prev;
+            idx = pos->cnt;
+        } else if (pos == &fakeChunk) {
+            pos = newChunkAfter(fakeChunk.prev);
+            idx = 0;
+        } else if (pos->cnt == ChunkCapacity) {
+            Chunk* upper = split(static_cast<Chunk*>(pos));
+            if (idx > pos->cnt) {
+                idx -= pos->cnt;
+                pos = upper;
+            }
+        }
+
+        auto chunk = static_cast<Chunk*>(pos);
+        shiftRight(chunk, idx);
+        try {
+            AllocatorTraits::construct(alloc, chunk->at(idx), std::forward<Args>(args)...);
+        } catch (...) {
+            ++chunk->cnt;
+            shiftLeft(chunk, idx);
+            --chunk->cnt;
+            if (chunk->cnt == 0) {
+                deleteChunk(chunk);
+            }
+            throw;
+        }
+        ++chunk->cnt;
+        ++sz;
+        return iterator(chunk, idx);
+    }
+
+    iterator insert(const_iterator it, const T& val) {
+        return emplace(it, val);
+    }
+
+    iterator erase(const_iterator it) {
+        auto chunk = static_cast<Chunk*>(it.chunkPtr);
+        size_t idx = it.idx;
+
+        AllocatorTraits::destroy(alloc, chunk->at(idx));
+        shiftLeft(chunk, idx);
+        --chunk->cnt;
+        --sz;
+
+        if (chunk->cnt == 0) {
+            baseChunk* next = chunk->next;
+            deleteChunk(chunk);
+            return iterator(next, 0);
+        }
+
+        baseChunk* pos = chunk;
+        if (chunk->cnt < ChunkCapacity / 2) {
+            std::tie(pos, idx) = rebalance(chunk, idx);
+        }
+        if (idx == pos->cnt) {
+            return iterator(pos->next, 0);
+        }
+        return iterator(pos, idx);
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&& ... args) {
+        emplace(cend(), std::forward<Args>(args)...);
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&& ... args) {
+        emplace(cbegin(), std::forward<Args>(args)...);
+    }
+
+    void push_front(const T& value) {
+        emplace_front(value);
+    }
+
+    void push_front(T&& value) {
+        emplace_front(std::move(value));
+    }
+
+    void pop_back() {
+        erase(--cend());
+    }
+
+    void pop_front() {
+        erase(cbegin());
+    }
+
+    iterator begin() {
+        return iterator(fakeChunk.next, 0);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(fakeChunk.next, 0);
+    }
+
+    iterator end() {
+        return iterator(&fakeChunk, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(const_cast<baseChunk*>(&fakeChunk), 0);
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator crend() const {
+        return const_reverse_iterator(begin());
+    }
+};
+
+
+//Michael-Scott MPMC queue, retired nodes are freed through hazard pointers,
+//the allocator has to be safe to call from several threads (std::allocator, ThreadArenaAllocator)
+template <typename T, typename Allocator = std::allocator<T>>
+class ConcurrentQueue {
+    //like List's Node, but next is atomic and the value is built in place:
+    //the dummy node at the head holds no value
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* valPtr() {
+            return reinterpret_cast<T*>(storage);
+        }
+    };
+
+    static constexpr size_t HAZARDS_PER_RECORD = 2;
+    static constexpr size_t MIN_RETIRED_TO_SCAN = 64;
+
+    //taken by one operation at a time, retired nodes stay with the record until a scan frees them
+    struct HazardRecord {
+        std::atomic<bool> active{true};
+        std::atomic<Node*> hazards[HAZARDS_PER_RECORD] = {};
+        std::vector<Node*> retired;
+        HazardRecord* next = nullptr;
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeAllocatorTraits = std::allocator_traits<NodeAllocator>;
+
+    NodeAllocator nodeAlloc;
+    Allocator alloc;
+    alignas(64) std::atomic<Node*> head;
+    alignas(64) std::atomic<Node*> tail;
+    alignas(64) std::atomic<HazardRecord*> records{nullptr};
+    std::atomic<size_t> recordCnt{0};
+
+    class RecordGuard {
+    private:
+        HazardRecord* record;
+
+    public:
+        explicit RecordGuard(ConcurrentQueue& queue) : record(queue.acquireRecord()) {}
+
+        RecordGuard(const RecordGuard&) = delete;
+
+        RecordGuard& operator=(const RecordGuard&) = delete;
+
+        ~RecordGuard() {
+            for (std::atomic<Node*>& hazard : record->hazards) {
+                hazard.store(nullptr, std::memory_order_release);
+            }
+            record->active.store(false, std::memory_order_release);
+        }
+
+        HazardRecord* operator->() const {
+            return record;
+        }
+
+        HazardRecord* get() const {
+            return record;
+        }
+    };
+
+    HazardRecord* acquireRecord() {
+        for (HazardRecord* record = records.load(std::memory_order_acquire); record; record = record->next) {
+            bool expected = false;
+            if (!record->active.load(std::memory_order_relaxed) &&
+                record->active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+
+        auto record = new HazardRecord();
+        recordCnt.fetch_add(1, std::memory_order_relaxed);
+        record->next = records.load(std::memory_order_relaxed);
+        while (!records.compare_exchange_weak(record->next, record,
+                                              std::memory_order_release, std::memory_order_relaxed)) {}
+        return record;
+    }
+
+    //publishes the hazard and re-reads until the source still points at it, after that the node cannot be freed
+    static Node* protect(std::atomic<Node*>& hazard, const std::atomic<Node*>& source) {
+        Node* node = source.load();
+        while (true) {
+            hazard.store(node);
+            Node* again = source.load();
+            if (again == node)
+                return node;
+            node = again;
+        }
+    }
+
+    void retire(HazardRecord* record, Node* node) {
+        record->retired.push_back(node);
+        if (record->retired.size() >= std::max(MIN_RETIRED_TO_SCAN,
+                                               2 * HAZARDS_PER_RECORD * recordCnt.load(std::memory_order_relaxed))) {
+            scan(record);
+        }
+    }
+
+    void scan(HazardRecord* record) {
+        std::vector<Node*> guarded;
+        for (HazardRecord* other = records.load(std::memory_order_acquire); other; other = other->next) {
+            for (std::atomic<Node*>& hazard : other->hazards) {
+                if (Node* node = hazard.load()) {
+                    guarded.push_back(node);
+                }
+            }
+        }
+        std::sort(guarded.begin(), guarded.end());
+
+        size_t kept = 0;
+        for (Node* node : record->retired) {
+            if (std::binary_search(guarded.begin(), guarded.end(), node)) {
+                record->retired[kept++] = node;
+            } else {
+                NodeAllocatorTraits::deallocate(nodeAlloc, node, 1);
+            }
+        }
+        record->retired.resize(kept);
+    }
+
+    Node* allocateNode() {
+        Node* node = NodeAllocatorTraits::allocate(nodeAlloc, 1);
+        new(node) Node();
+        return node;
+    }
+
+public:
+    explicit ConcurrentQueue(const Allocator& allocator = Allocator()) :
+            nodeAlloc(allocator), alloc(allocator) {
+        Node* dummy = allocateNode();
+        head.store(dummy, std::memory_order_relaxed);
+        tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    ConcurrentQueue(const ConcurrentQueue&) = delete;
+
+    ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+    //must not race with any other operation
+    ~ConcurrentQueue() {
+        Node* node = head.load(std::memory_order_relaxed);
+        Node* next = node->next.load(std::memory_order_relaxed);
+        NodeAllocatorTraits::deallocate(nodeAlloc, node, 1);
+        for (node = next; node; node = next) {
+            next = node->next.load(std::memory_order_relaxed);
+            std::allocator_traits<Allocator>::destroy(alloc, node->valPtr());
+            NodeAllocatorTraits::deallocate(nodeAlloc, node, 1);
+        }
+
+        HazardRecord* record = records.load(std::memory_order_relaxed);
+        while (record) {
+            HazardRecord* nextRecord = record->next;
+            for (Node* retired : record->retired) {
+                NodeAllocatorTraits::deallocate(nodeAlloc, retired, 1);
+            }
+            delete record;
+            record = nextRecord;
+        }
+    }
+
+    template <typename... Args>
+    void emplace(Args&& ... args) {
+        Node* node = allocateNode();
+        try {
+            std::allocator_traits<Allocator>::construct(alloc, node->valPtr(), std::forward<Args>(args)...);
+        }
+        catch (...) {
+            NodeAllocatorTraits::deallocate(nodeAlloc, node, 1);
+            throw;
+        }
+
+        RecordGuard record(*this);
+        while (true) {
+            Node* last = protect(record->hazards[0], tail);
+            Node* next = last->next.load(std::memory_order_acquire);
+            if (last != tail.load(std::memory_order_acquire))
+                continue;
+
+            //tail is lagging behind, help to move it before retrying
+            if (next) {
+                tail.compare_exchange_weak(last, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+            if (last->next.compare_exchange_weak(next, node, std::memory_order_release, std::memory_order_relaxed)) {
+                tail.compare_exchange_strong(last, node, std::memory_order_release, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    void push(const T& val) {
+        emplace(val);
+    }
+
+    void push(T&& val) {
+        emplace(std::move(val));
+    }
+
+    //false if the queue was seen empty
+    bool try_pop(T& out) {
+        RecordGuard record(*this);
+        while (true) {
+            Node* first = protect(record->hazards[0], head);
+            Node* last = tail.load(std::memory_order_acquire);
+            Node* next = protect(record->hazards[1], first->next);
+            if (first != head.load(std::memory_order_acquire))
+                continue;
+
+            if (!next)
+                return false;
+            if (first == last) {
+                tail.compare_exchange_weak(last, next, std::memory_order_release, std::memory_order_relaxed);
+                continue;
+            }
+            //only the thread that moved head touches the value, next becomes the new dummy
+            if (head.compare_exchange_weak(first, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                out = std::move(*next->valPtr());
+                std::allocator_traits<Allocator>::destroy(alloc, next->valPtr());
+                retire(record.get(), first);
+                return true;
+            }
+        }
+    }
+};
+
+
+//links elements through a ListHook member instead of allocating nodes, elements are never owned:
+//the caller keeps them alive while linked, clear() and the destructor only unlink
+template <typename T, ListHook T::* Hook>
+class IntrusiveList {
+private:
+    size_t sz = 0;
+    ListHook fakeNode;
+
+    static ListHook* hookOf(const T& val) {
+        return const_cast<ListHook*>(&(val.*Hook));
+    }
+
+    //the hook's offset is read off the member pointer, applied to a suitably aligned dummy address
+    static T* ownerOf(ListHook* hook) {
+        static const ptrdiff_t offset = [] {
+            auto dummy = reinterpret_cast<T*>(alignof(std::max_align_t) * alignof(T));
+            return reinterpret_cast<char*>(&(dummy->*Hook)) - reinterpret_cast<char*>(dummy);
+        }();
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(hook) - offset);
+    }
+
+    template <bool isConst>
+    class TemplateIterator {
+    public:
+        ListHook* nodePtr;
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using reference = std::conditional_t<isConst, const T&, T&>;
+        using pointer = std::conditional_t<isConst, const T*, T*>;
+        using difference_type = std::ptrdiff_t;
+
+        explicit TemplateIterator(ListHook* nodePtr) : nodePtr(nodePtr) {}
+
+        TemplateIterator(const TemplateIterator& that) = default;
+
+        operator TemplateIterator<true>() const {
+            return TemplateIterator<true>(nodePtr);
+        }
+
+        reference operator*() const {
+            return *ownerOf(nodePtr);
+        }
+
+        pointer operator->() const {
+            return ownerOf(nodePtr);
+        }
+
+        TemplateIterator& operator++() {
+            nodePtr = nodePtr->next;
+            return *this;
+        }
+
+        TemplateIterator operator++(int) {
+            TemplateIterator tmp(*this);
+            nodePtr = nodePtr->next;
+            return tmp;
+        }
+
+        TemplateIterator& operator--() {
+            nodePtr = nodePtr->prev;
+            return *this;
+        }
+
+        TemplateIterator operator--(int) {
+            TemplateIterator tmp(*this);
+            nodePtr = nodePtr->prev;
+            return tmp;
+        }
+
+        bool operator==(const TemplateIterator& x) const {
+            return nodePtr == x.nodePtr;
+        }
+
+        bool operator!=(const TemplateIterator& x) const {
+            return nodePtr != x.nodePtr;
+        }
+    };
+
+public:
+    using iterator = TemplateIterator<false>;
+    using const_iterator = TemplateIterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    IntrusiveList() = default;
+
+    IntrusiveList(const IntrusiveList&) = delete;
+
+    IntrusiveList& operator=(const IntrusiveList&) = delete;
+
+    IntrusiveList(IntrusiveList&& that) noexcept {
+        swap(that);
+    }
+
+    IntrusiveList& operator=(IntrusiveList&& that) noexcept {
+        clear();
+        swap(that);
+        return *this;
+    }
+
+    ~IntrusiveList() {
+        clear();
+    }
+
+    void swap(IntrusiveList& that) {
+        std::swap(sz, that.sz);
+        fakeNode.swap(that.fakeNode);
+    }
+
+    [[nodiscard]] size_t size() const {
+        return sz;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return sz == 0;
+    }
+
+    void clear() {
+        while (sz > 0) {
+            pop_back();
+        }
+    }
+
+    //val must not be linked into another list through the same hook
+    iterator insert(const_iterator it, T& val) {
+        ListHook* hook = hookOf(val);
+        it.nodePtr->prev->link(hook);
+        hook->link(it.nodePtr);
+        ++sz;
+        return iterator(hook);
+    }
+
+    iterator erase(const_iterator it) {
+        ListHook* next = it.nodePtr->next;
+        it.nodePtr->unlink();
+        --sz;
+        return iterator(next);
+    }
+
+    void remove(T& val) {
+        erase(iterator_to(val));
+    }
+
+    void push_back(T& val) {
+        insert(cend(), val);
+    }
+
+    void push_front(T& val) {
+        insert(cbegin(), val);
+    }
+
+    void pop_back() {
+        erase(--cend());
+    }
+
+    void pop_front() {
+        erase(cbegin());
+    }
+
+    T& front() {
+        return *begin();
+    }
+
+    const T& front() const {
+        return *begin();
+    }
+
+    T& back() {
+        return *--end();
+    }
+
+    const T& back() const {
+        return *--end();
+    }
+
+    //O(1) relinking of an element of this or another list, e.g. an LRU touch is splice(begin(), *this, it)
+    void splice(const_iterator pos, IntrusiveList& that, const_iterator it) {
+        if (pos == it)
+            return;
+        ListHook* hook = it.nodePtr;
+        hook->unlink();
+        pos.nodePtr->prev->link(hook);
+        hook->link(pos.nodePtr);
+        ++sz;
+        --that.sz;
+    }
+
+    static iterator iterator_to(T& val) {
+        return iterator(hookOf(val));
+    }
+
+    static const_iterator iterator_to(const T& val) {
+        return const_iterator(hookOf(val));
+    }
+
+    iterator begin() {
+        return iterator(fakeNode.next);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(fakeNode.next);
+    }
+
+    iterator end() {
+        return iterator(&fakeNode);
+    }
+
+    const_iterator end() const {
+        return const_iterator(const_cast<ListHook*>(&fakeNode));
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator crend() const {
+        return const_reverse_iterator(begin());
+    }
+};
+
+
+//ordered map on a skip list, nodes come from the same allocator plumbing as List's (StackAllocator, PoolAllocator, ...);
+//insert/emplace, find, lower_bound and iteration are lock-free and may run concurrently with each other,
+//erase and clear need exclusive access, and concurrent inserts need a thread-safe allocator
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+        typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class SkipList {
+public:
+    using NodeType = std::pair<const Key, Value>;
+
+private:
+    static constexpr int MAX_HEIGHT = 20;
 
+    //the links of a node of height h follow it in memory, the value is built in place by the allocator
+    struct alignas(std::max(alignof(NodeType), alignof(std::atomic<void*>))) Node {
+        int height;
+        alignas(NodeType) unsigned char storage[sizeof(NodeType)];
 
-    T* allocate(size_t toAlloc) {
-        return reinterpret_cast<T*>(stack.alloc(sizeof(T) * toAlloc, alignof(T)));
-    }
+        explicit Node(int height) : height(height) {
+            for (int i = 0; i < height; ++i) {
+                new(links() + i) std::atomic<Node*>(nullptr);
+            }
+        }
 
-    void deallocate(T*, size_t) {}
+        std::atomic<Node*>* links() {
+            return reinterpret_cast<std::atomic<Node*>*>(this + 1);
+        }
 
-    using value_type = T;
+        NodeType& keyVal() {
+            return *reinterpret_cast<NodeType*>(storage);
+        }
 
-    template <typename U>
-    struct rebind {
-        using other = StackAllocator<U, cap>;
+        const Key& key() {
+            return keyVal().first;
+        }
     };
 
-    bool operator==(const StackAllocator& that) {
-        return stack == that.stack;
-    }
+    //a node of height h together with its links, one type per height so that every node is a single
+    //object to the allocator and fixed-size pools (PoolAllocator, ThreadArenaAllocator, ...) serve it
+    template <int Height>
+    struct Tower {
+        Node node;
+        std::atomic<Node*> links[Height];
+    };
 
-    bool operator!=(const StackAllocator& that) {
-        return !(stack == that.stack);
-    }
-};
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
 
-template <typename T, typename Allocator = std::allocator<T>>
-class List {
-    struct baseNode {
-        baseNode* next = this;
-        baseNode* prev = this;
+    template <int Height>
+    using TowerAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Tower<Height>>;
 
-        void link(baseNode* that) {
-            next = that;
-            that->prev = this;
+    Compare comp;
+    NodeAlloc nodeAlloc;
+    Alloc alloc;
+    Node* head;
+    std::atomic<int> height{1};
+    std::atomic<size_t> sz{0};
+
+    template <int Height = 1>
+    Node* allocateNode(int height) {
+        if constexpr (Height < MAX_HEIGHT) {
+            if (height != Height)
+                return allocateNode<Height + 1>(height);
         }
+        TowerAlloc<Height> towerAlloc(nodeAlloc);
+        Tower<Height>* tower = std::allocator_traits<TowerAlloc<Height>>::allocate(towerAlloc, 1);
+        return new(&tower->node) Node(height);
+    }
 
-        void swap(baseNode& that) {
-            if (next == this && &that == that.next) {
-                return;
-            }
-            if (next != this && &that == that.next) {
-                that.link(next);
-                prev->link(&that);
-                next = this;
-                prev = this;
-                return;
-            }
-            if (next == this && &that != that.next) {
-                that.swap(*this);
-                return;
-            }
-            if (next != this && &that != that.next) {
-                baseNode tmp;
-                tmp.swap(that);
-                this->swap(that);
-                this->swap(tmp);
+    template <int Height = 1>
+    void deallocateNode(Node* node) {
+        if constexpr (Height < MAX_HEIGHT) {
+            if (node->height != Height) {
+                deallocateNode<Height + 1>(node);
                 return;
             }
         }
-    };
-
-    struct Node : baseNode {
-        T val;
-
-        explicit Node(const T& val) : baseNode(), val(val) {}
+        TowerAlloc<Height> towerAlloc(nodeAlloc);
+        std::allocator_traits<TowerAlloc<Height>>::deallocate(towerAlloc, reinterpret_cast<Tower<Height>*>(node), 1);
+    }
 
-        template <typename... Args>
-        explicit Node(Args&& ... args) : baseNode(), val(std::forward<Args>(args)...) {}
-    };
+    void deleteNode(Node* node) {
+        std::allocator_traits<Alloc>::destroy(alloc, &node->keyVal());
+        deallocateNode(node);
+    }
 
-    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
-    using NodeAllocatorTraits = std::allocator_traits<NodeAllocator>;
+    //each level is kept with probability 1/4, from a per-thread xorshift
+    static int randomHeight() {
+        thread_local uint64_t state = 0x9E3779B97F4A7C15ull ^ reinterpret_cast<uintptr_t>(&state);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int height = 1;
+        for (uint64_t bits = state; height < MAX_HEIGHT && (bits & 3) == 0; bits >>= 2) {
+            ++height;
+        }
+        return height;
+    }
 
-private:
-    NodeAllocator nodeAlloc;
-    Allocator alloc;
-    size_t sz = 0;
-    baseNode fakeNode;
+    void raiseHeight(int newHeight) {
+        int current = height.load(std::memory_order_relaxed);
+        while (current < newHeight &&
+               !height.compare_exchange_weak(current, newHeight, std::memory_order_relaxed)) {}
+    }
 
-    template <typename... Args>
-    Node* newNode(Args&& ... args) {
-        Node* newNode = NodeAllocatorTraits::allocate(nodeAlloc, 1);
-        try {
-            std::allocator_traits<Allocator>::construct(alloc, newNode, std::forward<Args>(args)...);
-        }
-        catch (...) {
-            NodeAllocatorTraits::deallocate(nodeAlloc, newNode, 1);
-            throw;
+    //fills preds/succs with the last node before key and the first one not before it on every level
+    void locate(const Key& key, Node** preds, Node** succs) const {
+        Node* pred = head;
+        for (int level = MAX_HEIGHT - 1; level >= 0; --level) {
+            Node* curr = level < height.load(std::memory_order_relaxed)
+                         ? pred->links()[level].load(std::memory_order_acquire) : nullptr;
+            while (curr && comp(curr->key(), key)) {
+                pred = curr;
+                curr = curr->links()[level].load(std::memory_order_acquire);
+            }
+            preds[level] = pred;
+            succs[level] = curr;
         }
-        return newNode;
     }
 
-    void deleteNode(Node* toDel) {
-        std::allocator_traits<Allocator>::destroy(alloc, toDel);
-        NodeAllocatorTraits::deallocate(nodeAlloc, toDel, 1);
+    Node* lowerBoundNode(const Key& key) const {
+        Node* pred = head;
+        Node* curr = nullptr;
+        for (int level = height.load(std::memory_order_relaxed) - 1; level >= 0; --level) {
+            curr = pred->links()[level].load(std::memory_order_acquire);
+            while (curr && comp(curr->key(), key)) {
+                pred = curr;
+                curr = curr->links()[level].load(std::memory_order_acquire);
+            }
+        }
+        return curr;
     }
 
+    //links node in unless its key is taken; a node becomes visible once it is on level 0,
+    //upper levels are only shortcuts and are filled in afterwards
+    std::pair<Node*, bool> insertNode(Node* node) {
+        Node* preds[MAX_HEIGHT];
+        Node* succs[MAX_HEIGHT];
+        raiseHeight(node->height);
+
+        while (true) {
+            locate(node->key(), preds, succs);
+            if (succs[0] && !comp(node->key(), succs[0]->key()))
+                return {succs[0], false};
+
+            for (int level = 0; level < node->height; ++level) {
+                node->links()[level].store(succs[level], std::memory_order_relaxed);
+            }
+            if (preds[0]->links()[0].compare_exchange_strong(succs[0], node, std::memory_order_release,
+                                                             std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        for (int level = 1; level < node->height; ++level) {
+            while (!preds[level]->links()[level].compare_exchange_strong(succs[level], node,
+                                                                         std::memory_order_release,
+                                                                         std::memory_order_relaxed)) {
+                locate(node->key(), preds, succs);
+                node->links()[level].store(succs[level], std::memory_order_relaxed);
+            }
+        }
+        sz.fetch_add(1, std::memory_order_relaxed);
+        return {node, true};
+    }
 
     template <bool isConst>
     class TemplateIterator {
     public:
-        baseNode* nodePtr;
-        T* valPtr;
+        Node* nodePtr;
     public:
-        using iterator_category = std::bidirectional_iterator_tag;
-        using value_type = T;
-        using reference = std::conditional_t<isConst, const T&, T&>;
-        using pointer = std::conditional_t<isConst, const T*, T*>;
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = NodeType;
+        using reference = std::conditional_t<isConst, const NodeType&, NodeType&>;
+        using pointer = std::conditional_t<isConst, const NodeType*, NodeType*>;
         using difference_type = std::ptrdiff_t;
 
-        TemplateIterator(baseNode* nodePtr, T* valPtr) : nodePtr(nodePtr), valPtr(valPtr) {}
+        explicit TemplateIterator(Node* nodePtr) : nodePtr(nodePtr) {}
 
         TemplateIterator(const TemplateIterator& that) = default;
 
-        explicit TemplateIterator(Node* nodePtr) : TemplateIterator(static_cast<baseNode*>(nodePtr), &(nodePtr->val)) {}
-
         operator TemplateIterator<true>() const {
-            return TemplateIterator<true>(nodePtr, valPtr);
+            return TemplateIterator<true>(nodePtr);
         }
 
         reference operator*() const {
-            return *valPtr;
+            return nodePtr->keyVal();
         }
 
         pointer operator->() const {
-            return valPtr;
+            return &nodePtr->keyVal();
         }
 
         TemplateIterator& operator++() {
-            nodePtr = (nodePtr->next);
-            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            nodePtr = nodePtr->links()[0].load(std::memory_order_acquire);
             return *this;
         }
 
         TemplateIterator operator++(int) {
             TemplateIterator tmp(*this);
-            nodePtr = (nodePtr->next);
-            valPtr = &(static_cast<Node*>(nodePtr)->val);
+            ++*this;
             return tmp;
         }
 
-        TemplateIterator& operator--() {
-            nodePtr = (nodePtr->prev);
-            valPtr = &(static_cast<Node*>(nodePtr)->val);
-            return *this;
-        }
-
-        TemplateIterator& operator--(int) {
-            nodePtr = (nodePtr->prev);
-            valPtr = &(static_cast<Node*>(nodePtr)->val);
-            return *this;
-        }
-
         bool operator==(const TemplateIterator& x) const {
             return nodePtr == x.nodePtr;
         }
@@ -205,210 +2480,134 @@ private:
 public:
     using iterator = TemplateIterator<false>;
     using const_iterator = TemplateIterator<true>;
-    using reverse_iterator = std::reverse_iterator<iterator>;
-    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-    void clear() {
-        while (sz > 0) {
-            pop_back();
-        }
-    }
+    explicit SkipList(const Compare& comp = Compare(), const Alloc& allocator = Alloc()) :
+            comp(comp), nodeAlloc(allocator), alloc(allocator), head(allocateNode(MAX_HEIGHT)) {}
 
-    explicit List(size_t size, const T& val, const Allocator& allocator = Allocator()) :
-            nodeAlloc(allocator), alloc(allocator) {
-        try {
-            for (size_t i = 0; i < size; ++i) {
-                push_back(val);
-            }
-        }
-        catch (...) {
-            clear();
-            throw;
-        }
-    }
+    explicit SkipList(const Alloc& allocator) : SkipList(Compare(), allocator) {}
 
-    explicit List(size_t size, const Allocator& allocator = Allocator()) :
-            nodeAlloc(allocator), alloc(allocator) {
-        try {
-            for (size_t i = 0; i < size; ++i) {
-                emplace_back();
-            }
-        }
-        catch (...) {
-            clear();
-            throw;
-        }
+    SkipList(const SkipList&) = delete;
+
+    SkipList& operator=(const SkipList&) = delete;
+
+    ~SkipList() {
+        clear();
+        deallocateNode(head);
     }
 
-    explicit List(const Allocator& allocator = Allocator()) :
-            nodeAlloc(allocator), alloc(allocator) {}
+    [[nodiscard]] size_t size() const {
+        return sz.load(std::memory_order_relaxed);
+    }
 
-    Allocator get_allocator() const {
-        return alloc;
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
     }
 
-    List(const List& that) :
-            nodeAlloc(std::allocator_traits<Allocator>::select_on_container_copy_construction(that.nodeAlloc)),
-            alloc(std::allocator_traits<Allocator>::select_on_container_copy_construction(that.alloc)) {
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&& ... args) {
+        Node* node = allocateNode(randomHeight());
         try {
-            for (const T& val : that) {
-                push_back(val);
-            }
+            std::allocator_traits<Alloc>::construct(alloc, &node->keyVal(), std::forward<Args>(args)...);
         }
         catch (...) {
-            clear();
+            deallocateNode(node);
             throw;
         }
-    }
-
-
-    ~List() {
-        clear();
-    }
-
-    void swap(List& that) {
-        std::swap(nodeAlloc, that.nodeAlloc);
-        std::swap(alloc, that.alloc);
-        std::swap(sz, that.sz);
-        fakeNode.swap(that.fakeNode);
-    }
-
-
-    List(List&& that) {
-        this->swap(that);
-    }
-
-    List& operator=(List&& that) noexcept {
-        clear();
-        this->swap(that);
-    }
 
-    List& operator=(const List& that) {
-        NodeAllocator newAlloc = std::allocator_traits<Allocator>::propagate_on_container_copy_assignment::value
-                                         ? that.alloc : alloc;
-        List<T, Allocator> tmp(newAlloc);
-
-        for (const T& val : that) {
-            tmp.push_back(val);
+        std::pair<Node*, bool> result = insertNode(node);
+        if (!result.second) {
+            deleteNode(node);
         }
-
-        this->swap(tmp);
-        return *this;
-    }
-
-    [[nodiscard]] size_t size() const {
-        return sz;
+        return {iterator(result.first), result.second};
     }
 
-    template <typename... Args>
-    void emplace_back(Args&& ... args) {
-        Node* nodePtr = newNode(std::forward<Args>(args)...);
-        fakeNode.prev->link(nodePtr);
-        nodePtr->link(&fakeNode);
-        ++sz;
-    }
-
-    void push_back(const T& value) {
-        emplace_back(value);
+    std::pair<iterator, bool> insert(const NodeType& node) {
+        return emplace(node);
     }
 
-    template <typename... Args>
-    void push_back(Args&& ... args) {
-        emplace_back(std::forward<Args>(args)...);
+    Value& operator[](const Key& key) {
+        iterator it = find(key);
+        if (it != end())
+            return it->second;
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
     }
 
-    template <typename... Args>
-    void emplace_front(Args&& ... args) {
-        Node* nodePtr = newNode(std::forward<Args>(args)...);
-        nodePtr->link(fakeNode.next);
-        fakeNode.link(nodePtr);
-        ++sz;
+    iterator lower_bound(const Key& key) {
+        return iterator(lowerBoundNode(key));
     }
 
-    void push_front(const T& value) {
-        emplace_front(value);
+    const_iterator lower_bound(const Key& key) const {
+        return const_iterator(lowerBoundNode(key));
     }
 
-    template <typename... Args>
-    void push_front(Args&& ... args) {
-        emplace_front(std::forward<Args>(args)...);
+    iterator find(const Key& key) {
+        Node* node = lowerBoundNode(key);
+        return iterator(node && !comp(key, node->key()) ? node : nullptr);
     }
 
-    void pop_back() {
-        Node* toDel = static_cast<Node*>(fakeNode.prev);
-        toDel->prev->link(&fakeNode);
-        deleteNode(static_cast<Node*>(toDel));
-        --sz;
+    const_iterator find(const Key& key) const {
+        Node* node = lowerBoundNode(key);
+        return const_iterator(node && !comp(key, node->key()) ? node : nullptr);
     }
 
-    void pop_front() {
-        Node* toDel = static_cast<Node*>(fakeNode.next);
-        fakeNode.link(toDel->next);
-        deleteNode(static_cast<Node*>(toDel));
-        --sz;
+    bool contains(const Key& key) const {
+        return find(key) != end();
     }
 
-    void insert(const_iterator it, const T& val) {
-        Node* toIns = newNode(val);
-        it.nodePtr->prev->link(toIns);
-        toIns->link(it.nodePtr);
-        ++sz;
+    //not safe against any concurrent operation
+    size_t erase(const Key& key) {
+        Node* preds[MAX_HEIGHT];
+        Node* succs[MAX_HEIGHT];
+        locate(key, preds, succs);
+        Node* node = succs[0];
+        if (!node || comp(key, node->key()))
+            return 0;
+
+        for (int level = 0; level < node->height; ++level) {
+            preds[level]->links()[level].store(node->links()[level].load(std::memory_order_relaxed),
+                                               std::memory_order_relaxed);
+        }
+        deleteNode(node);
+        sz.fetch_sub(1, std::memory_order_relaxed);
+        return 1;
     }
 
-    void erase(const_iterator it) {
-        Node* toDel = static_cast<Node*>(it.nodePtr);
-        toDel->prev->link(toDel->next);
-        deleteNode(toDel);
-        --sz;
+    //not safe against any concurrent operation
+    void clear() {
+        Node* node = head->links()[0].load(std::memory_order_relaxed);
+        while (node) {
+            Node* next = node->links()[0].load(std::memory_order_relaxed);
+            deleteNode(node);
+            node = next;
+        }
+        for (int level = 0; level < MAX_HEIGHT; ++level) {
+            head->links()[level].store(nullptr, std::memory_order_relaxed);
+        }
+        height.store(1, std::memory_order_relaxed);
+        sz.store(0, std::memory_order_relaxed);
     }
 
-
     iterator begin() {
-        return iterator(static_cast<Node*>(fakeNode.next));
+        return iterator(head->links()[0].load(std::memory_order_acquire));
     }
 
     const_iterator begin() const {
-        return const_iterator(const_cast<Node*>(static_cast<const Node*>(fakeNode.next)));
+        return const_iterator(head->links()[0].load(std::memory_order_acquire));
     }
 
     iterator end() {
-        return iterator(&fakeNode, nullptr);
+        return iterator(nullptr);
     }
 
     const_iterator end() const {
-        return const_iterator(const_cast<baseNode*>(&fakeNode), nullptr);
+        return const_iterator(nullptr);
     }
 
     const_iterator cbegin() const {
-        return const_iterator(begin());
+        return begin();
     }
 
     const_iterator cend() const {
-        return const_iterator(end());
-    }
-
-    const_reverse_iterator rbegin() const {
-        return const_reverse_iterator(end());
-    }
-
-    const_reverse_iterator rend() const {
-        return const_reverse_iterator(begin());
-    }
-
-    reverse_iterator rbegin() {
-        return reverse_iterator(end());
-    }
-
-    reverse_iterator rend() {
-        return reverse_iterator(begin());
-    }
-
-    const_reverse_iterator crbegin() const {
-        return const_reverse_iterator(end());
-    }
-
-    const_reverse_iterator crend() const {
-        return const_reverse_iterator(begin());
+        return end();
     }
 };
-
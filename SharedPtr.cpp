@@ -1,4 +1,18 @@
 #include <memory>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include <typeindex>
+#include <unordered_map>
+#include <algorithm>
+#include <sstream>
 
 template <typename T>
 class SharedPtr;
@@ -6,20 +20,510 @@ class SharedPtr;
 template <typename T>
 class WeakPtr;
 
+template <typename T>
+class AtomicSharedPtr;
+
+template <typename T>
+class EnableSharedFromThis;
+
+template <typename T, typename U>
+void linkSharedFromThis(const SharedPtr<T>& owner, const EnableSharedFromThis<U>* base);
+
+template <typename T>
+void linkSharedFromThis(const SharedPtr<T>&, ...) {}
+
+//Y* may be adopted by SharedPtr<T>: for T = U[] only arrays of U itself are accepted
+template <typename Y, typename T>
+struct is_adoptable_ptr : std::is_convertible<Y*, T*> {};
+
+template <typename Y, typename T>
+struct is_adoptable_ptr<Y, T[]> : std::is_convertible<Y(*)[], T(*)[]> {};
+
+template <typename Y, typename T>
+struct default_deleter_for {
+    using type = std::default_delete<Y>;
+};
+
+template <typename Y, typename T>
+struct default_deleter_for<Y, T[]> {
+    using type = std::default_delete<Y[]>;
+};
+
 template <typename T, typename Alloc, typename... Args>
 SharedPtr<T> allocateShared(Alloc alloc, Args&& ... args);
 
+struct BaseControlBlock;
+
+//hooks called on every reference count event; the default policy is empty and compiles away
+struct NoRefCountInstrumentation {
+    template <typename T>
+    static void onCreate(BaseControlBlock*, const void*, size_t) {}
+
+    static void onObjectDestroyed(BaseControlBlock*) {}
+
+    static void onBlockDestroyed(BaseControlBlock*) {}
+
+    static void onAtomicOp(BaseControlBlock*) {}
+
+    static void onCopy(BaseControlBlock*) {}
+
+    static void onMove(BaseControlBlock*) {}
+
+    //handle is the address of a SharedPtr, block == nullptr means the handle owns nothing anymore
+    static void onAttach(const void*, BaseControlBlock*) {}
+};
+
+#ifdef SHARED_PTR_INSTRUMENTATION
+//debug policy: registers live control blocks and every SharedPtr, counts events per type;
+//it needs RTTI, so it only exists in instrumented builds
+class RefCountRegistry {
+public:
+    struct TypeStats {
+        std::string typeName;
+        size_t created = 0;
+        size_t live = 0;
+        size_t copies = 0;
+        size_t moves = 0;
+        size_t atomicOps = 0;
+    };
+
+    struct LiveObject {
+        std::string typeName;
+        const void* obj;
+        size_t strongCnt;
+        size_t weakCnt;
+        std::chrono::steady_clock::duration age;
+    };
+
+private:
+    struct BlockRecord {
+        std::type_index type;
+        const uint8_t* obj;
+        size_t size;
+        bool objAlive;
+        std::chrono::steady_clock::time_point created;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<BaseControlBlock*, BlockRecord> blocks;
+    std::unordered_map<const void*, BaseControlBlock*> handles;
+    std::unordered_map<std::type_index, TypeStats> stats;
+
+    static RefCountRegistry& instance() {
+        static RefCountRegistry registry;
+        return registry;
+    }
+
+    template <typename Func>
+    static void withRecord(BaseControlBlock* block, Func func) {
+        RefCountRegistry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto it = registry.blocks.find(block);
+        if (it != registry.blocks.end()) {
+            func(it->second, registry.stats.at(it->second.type));
+        }
+    }
+
+    static LiveObject describe(BaseControlBlock* block, const BlockRecord& record,
+                               const TypeStats& typeStats, std::chrono::steady_clock::time_point now);
+
+public:
+    template <typename T>
+    static void onCreate(BaseControlBlock* block, const void* obj, size_t size) {
+        const std::type_info& type = typeid(T);
+        RefCountRegistry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.blocks.insert({block, {type, static_cast<const uint8_t*>(obj), size, true,
+                                        std::chrono::steady_clock::now()}});
+        TypeStats& typeStats = registry.stats[type];
+        typeStats.typeName = type.name();
+        ++typeStats.created;
+        ++typeStats.live;
+    }
+
+    static void onObjectDestroyed(BaseControlBlock* block) {
+        withRecord(block, [](BlockRecord& record, TypeStats& typeStats) {
+            record.objAlive = false;
+            --typeStats.live;
+        });
+    }
+
+    static void onBlockDestroyed(BaseControlBlock* block) {
+        RefCountRegistry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.blocks.erase(block);
+    }
+
+    static void onAtomicOp(BaseControlBlock* block) {
+        withRecord(block, [](BlockRecord&, TypeStats& typeStats) { ++typeStats.atomicOps; });
+    }
+
+    static void onCopy(BaseControlBlock* block) {
+        withRecord(block, [](BlockRecord&, TypeStats& typeStats) { ++typeStats.copies; });
+    }
+
+    static void onMove(BaseControlBlock* block) {
+        withRecord(block, [](BlockRecord&, TypeStats& typeStats) { ++typeStats.moves; });
+    }
+
+    static void onAttach(const void* handle, BaseControlBlock* block) {
+        RefCountRegistry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (block) {
+            registry.handles[handle] = block;
+        } else {
+            registry.handles.erase(handle);
+        }
+    }
+
+    static std::vector<TypeStats> typeStats() {
+        RefCountRegistry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::vector<TypeStats> result;
+        for (const auto& [type, typeStats] : registry.stats) {
+            result.push_back(typeStats);
+        }
+        return result;
+    }
+
+    //oldest first
+    static std::vector<LiveObject> liveObjects();
+
+    //live objects kept alive only by SharedPtrs stored inside other such objects, i.e. leaked cycles;
+    //arrays adopted from a raw pointer have an unknown extent and are not scanned for such SharedPtrs,
+    //so cycles through them are not reported (makeShared<T[]> arrays are)
+    static std::vector<LiveObject> leakedObjects();
+
+    static std::string report();
+};
+
+using RefCountInstrumentation = RefCountRegistry;
+#else
+using RefCountInstrumentation = NoRefCountInstrumentation;
+#endif
+
 struct BaseControlBlock {
-    size_t strongCnt = 0;
-    size_t weakCnt = 0;
+    //block is born owned by the SharedPtr that created it
+    std::atomic<size_t> strongCnt = 1;
+    //all strong owners together hold one extra weak reference
+    std::atomic<size_t> weakCnt = 1;
+    //object is destroyed by DeferredReclaimer instead of the thread that dropped the last owner
+    std::atomic<bool> deferred = false;
+    BaseControlBlock* nextDead = nullptr;
 
     virtual void* getObjPtr() = 0;
 
     virtual void destroyObj() = 0;
 
     virtual void BlockDestruction() = 0;
+
+    void incStrong() {
+        RefCountInstrumentation::onAtomicOp(this);
+        strongCnt.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool incStrongIfAlive() {
+        RefCountInstrumentation::onAtomicOp(this);
+        size_t cnt = strongCnt.load(std::memory_order_relaxed);
+        while (cnt != 0) {
+            if (strongCnt.compare_exchange_weak(cnt, cnt + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    void decStrong();
+
+    void reclaim() {
+        RefCountInstrumentation::onObjectDestroyed(this);
+        destroyObj();
+        decWeak();
+    }
+
+    void incWeak() {
+        RefCountInstrumentation::onAtomicOp(this);
+        weakCnt.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void decWeak() {
+        RefCountInstrumentation::onAtomicOp(this);
+        if (weakCnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            RefCountInstrumentation::onBlockDestroyed(this);
+            BlockDestruction();
+        }
+    }
 };
 
+#ifdef SHARED_PTR_INSTRUMENTATION
+inline RefCountRegistry::LiveObject RefCountRegistry::describe(BaseControlBlock* block, const BlockRecord& record,
+                                                               const TypeStats& typeStats,
+                                                               std::chrono::steady_clock::time_point now) {
+    return {typeStats.typeName, record.obj, block->strongCnt.load(), block->weakCnt.load(), now - record.created};
+}
+
+inline std::vector<RefCountRegistry::LiveObject> RefCountRegistry::liveObjects() {
+    RefCountRegistry& registry = instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::vector<LiveObject> result;
+    for (const auto& [block, record] : registry.blocks) {
+        if (record.objAlive) {
+            result.push_back(describe(block, record, registry.stats.at(record.type), now));
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const LiveObject& a, const LiveObject& b) {
+        return a.age > b.age;
+    });
+    return result;
+}
+
+inline std::vector<RefCountRegistry::LiveObject> RefCountRegistry::leakedObjects() {
+    RefCountRegistry& registry = instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    //live objects sorted by address, to find the object a SharedPtr is stored in
+    std::vector<std::pair<const uint8_t*, BaseControlBlock*>> objects;
+    for (const auto& [block, record] : registry.blocks) {
+        if (record.objAlive && block->strongCnt.load() > 0) {
+            objects.emplace_back(record.obj, block);
+        }
+    }
+    std::sort(objects.begin(), objects.end());
+
+    auto ownerOf = [&](const void* handle) -> BaseControlBlock* {
+        auto addr = static_cast<const uint8_t*>(handle);
+        auto it = std::upper_bound(objects.begin(), objects.end(), std::make_pair(addr, (BaseControlBlock*) nullptr),
+                                   [](const auto& a, const auto& b) { return a.first < b.first; });
+        if (it == objects.begin())
+            return nullptr;
+        --it;
+        const BlockRecord& record = registry.blocks.at(it->second);
+        return addr < record.obj + record.size ? it->second : nullptr;
+    };
+
+    std::unordered_map<BaseControlBlock*, size_t> internalRefs;
+    std::unordered_map<BaseControlBlock*, std::vector<BaseControlBlock*>> edges;
+    for (const auto& [handle, target] : registry.handles) {
+        BaseControlBlock* owner = ownerOf(handle);
+        if (owner) {
+            ++internalRefs[target];
+            edges[owner].push_back(target);
+        }
+    }
+
+    //anything with a reference from outside of the live objects is a root, everything reachable from roots is fine
+    std::unordered_map<BaseControlBlock*, bool> reached;
+    std::vector<BaseControlBlock*> stack;
+    for (const auto& [obj, block] : objects) {
+        if (block->strongCnt.load() > internalRefs[block]) {
+            reached[block] = true;
+            stack.push_back(block);
+        }
+    }
+    while (!stack.empty()) {
+        BaseControlBlock* block = stack.back();
+        stack.pop_back();
+        for (BaseControlBlock* next : edges[block]) {
+            if (!reached[next]) {
+                reached[next] = true;
+                stack.push_back(next);
+            }
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<LiveObject> result;
+    for (const auto& [obj, block] : objects) {
+        if (!reached[block]) {
+            const BlockRecord& record = registry.blocks.at(block);
+            result.push_back(describe(block, record, registry.stats.at(record.type), now));
+        }
+    }
+    return result;
+}
+
+inline std::string RefCountRegistry::report() {
+    std::ostringstream out;
+    out << "type: created/live, copies, moves, atomic ops\n";
+    for (const TypeStats& typeStats : typeStats()) {
+        out << typeStats.typeName << ": " << typeStats.created << "/" << typeStats.live << ", "
+            << typeStats.copies << ", " << typeStats.moves << ", " << typeStats.atomicOps << "\n";
+    }
+    out << "live objects, oldest first:\n";
+    for (const LiveObject& object : liveObjects()) {
+        out << object.typeName << " at " << object.obj << ", strong " << object.strongCnt
+            << ", age " << std::chrono::duration_cast<std::chrono::milliseconds>(object.age).count() << "ms\n";
+    }
+    out << "leaked in cycles:\n";
+    for (const LiveObject& object : leakedObjects()) {
+        out << object.typeName << " at " << object.obj << ", strong " << object.strongCnt << "\n";
+    }
+    return out.str();
+}
+#endif
+
+class DeferredReclaimer {
+    static const size_t WAKE_UP_DEPTH = 256;
+
+    //dead blocks are pushed lock-free and taken by whole batches
+    std::atomic<BaseControlBlock*> head = nullptr;
+
+    std::atomic<size_t> depth = 0;
+    std::atomic<size_t> peakDepth = 0;
+    std::atomic<size_t> enqueuedCnt = 0;
+    std::atomic<size_t> reclaimedCnt = 0;
+
+    //guards interval and activeBatches only, destructors run with it released,
+    //so they may enqueue, flush or setInterval themselves
+    std::mutex batchMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable batchDone;
+    std::chrono::milliseconds interval{1};
+    size_t activeBatches = 0;
+    std::atomic<bool> stopped = false;
+    std::thread worker;
+
+    DeferredReclaimer() : worker([this] { run(); }) {}
+
+    static bool& insideBatch() {
+        thread_local bool inside = false;
+        return inside;
+    }
+
+    size_t reclaimBatch() {
+        BaseControlBlock* block;
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            block = head.exchange(nullptr, std::memory_order_acquire);
+            ++activeBatches;
+        }
+
+        bool wasInside = insideBatch();
+        insideBatch() = true;
+        size_t cnt = 0;
+        while (block) {
+            BaseControlBlock* next = block->nextDead;
+            block->reclaim();
+            block = next;
+            ++cnt;
+        }
+        insideBatch() = wasInside;
+        depth.fetch_sub(cnt, std::memory_order_relaxed);
+        reclaimedCnt.fetch_add(cnt, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            --activeBatches;
+        }
+        batchDone.notify_all();
+        return cnt;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(batchMutex);
+        while (!stopped.load()) {
+            //sleeps until there is work, then waits interval so it is taken as one batch
+            wakeUp.wait(lock, [this] { return stopped.load() || head.load(std::memory_order_relaxed) != nullptr; });
+            wakeUp.wait_for(lock, interval, [this] {
+                return stopped.load() || depth.load(std::memory_order_relaxed) >= WAKE_UP_DEPTH;
+            });
+            lock.unlock();
+            reclaimBatch();
+            lock.lock();
+        }
+    }
+
+public:
+    struct Stats {
+        size_t depth;
+        size_t peakDepth;
+        size_t enqueued;
+        size_t reclaimed;
+    };
+
+    static DeferredReclaimer& instance() {
+        static DeferredReclaimer reclaimer;
+        return reclaimer;
+    }
+
+    DeferredReclaimer(const DeferredReclaimer&) = delete;
+
+    DeferredReclaimer& operator=(const DeferredReclaimer&) = delete;
+
+    ~DeferredReclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            stopped.store(true);
+        }
+        wakeUp.notify_one();
+        worker.join();
+        flush();
+    }
+
+    void enqueue(BaseControlBlock* block) {
+        if (stopped.load(std::memory_order_relaxed)) {
+            block->reclaim();
+            return;
+        }
+
+        //counted before it is published, so a batch taking it never drives depth below zero
+        enqueuedCnt.fetch_add(1, std::memory_order_relaxed);
+        size_t newDepth = depth.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t peak = peakDepth.load(std::memory_order_relaxed);
+        while (peak < newDepth && !peakDepth.compare_exchange_weak(peak, newDepth, std::memory_order_relaxed)) {}
+
+        BaseControlBlock* oldHead = head.load(std::memory_order_relaxed);
+        do {
+            block->nextDead = oldHead;
+        } while (!head.compare_exchange_weak(oldHead, block, std::memory_order_release, std::memory_order_relaxed));
+
+        //block may already be reclaimed here; the worker sleeps without a timeout on an empty queue,
+        //taking the mutex keeps the first push from slipping between its check and its wait
+        if (oldHead == nullptr) {
+            std::lock_guard<std::mutex> lock(batchMutex);
+        }
+        if (oldHead == nullptr || newDepth % WAKE_UP_DEPTH == 0) {
+            wakeUp.notify_one();
+        }
+    }
+
+    //reclaims what is still queued on the calling thread and waits for batches other threads have already
+    //taken, so everything enqueued before the call is gone on return; called from a destructor run by
+    //a batch it does not wait, as that batch may be its own
+    size_t flush() {
+        size_t cnt = reclaimBatch();
+        if (!insideBatch()) {
+            std::unique_lock<std::mutex> lock(batchMutex);
+            batchDone.wait(lock, [this] { return activeBatches == 0; });
+        }
+        return cnt;
+    }
+
+    void setInterval(std::chrono::milliseconds newInterval) {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        interval = newInterval;
+    }
+
+    size_t queueDepth() const {
+        return depth.load(std::memory_order_relaxed);
+    }
+
+    Stats stats() const {
+        return {depth.load(std::memory_order_relaxed), peakDepth.load(std::memory_order_relaxed),
+                enqueuedCnt.load(std::memory_order_relaxed), reclaimedCnt.load(std::memory_order_relaxed)};
+    }
+};
+
+inline void BaseControlBlock::decStrong() {
+    if (strongCnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (deferred.load(std::memory_order_relaxed)) {
+            DeferredReclaimer::instance().enqueue(this);
+            return;
+        }
+        reclaim();
+    }
+}
+
 template <typename T>
 class SharedPtr {
 
@@ -34,6 +538,15 @@ class SharedPtr {
     friend
     class SharedPtr;
 
+    friend
+    class AtomicSharedPtr<T>;
+
+    template <typename Y>
+    friend void deferReclamation(const SharedPtr<Y>& ptr);
+
+public:
+    using element_type = std::remove_extent_t<T>;
+
 private:
     template <typename Y, typename Deleter, typename Alloc>
     struct ControlBlockRegular : public BaseControlBlock {
@@ -101,19 +614,116 @@ private:
         }
     };
 
+    //control block and all elements of makeShared<E[]>(n) in one allocation, elements right after the block
+    template <typename Alloc>
+    struct alignas(element_type) alignas(BaseControlBlock) alignas(Alloc)
+    ControlBlockMakeSharedArray : public BaseControlBlock {
+        using BlockAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<ControlBlockMakeSharedArray<Alloc>>;
+        using BlockAllocTraits = typename std::allocator_traits<BlockAlloc>;
+        using EAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<element_type>;
+        using EAllocTraits = typename std::allocator_traits<EAlloc>;
+
+        Alloc alloc;
+        size_t cnt = 0;
+        size_t units;
+
+        static size_t elemsOffset() {
+            return (sizeof(ControlBlockMakeSharedArray) + alignof(element_type) - 1)
+                   / alignof(element_type) * alignof(element_type);
+        }
+
+        static size_t unitsFor(size_t n) {
+            return (elemsOffset() + n * sizeof(element_type) + sizeof(ControlBlockMakeSharedArray) - 1)
+                   / sizeof(ControlBlockMakeSharedArray);
+        }
+
+        element_type* elems() {
+            return reinterpret_cast<element_type*>(reinterpret_cast<uint8_t*>(this) + elemsOffset());
+        }
+
+        template <typename ... Args>
+        ControlBlockMakeSharedArray(Alloc alloc, size_t units, size_t n, const Args& ... args) :
+                alloc(alloc), units(units) {
+            EAlloc allocElem(alloc);
+            try {
+                for (; cnt < n; ++cnt) {
+                    EAllocTraits::construct(allocElem, elems() + cnt, args...);
+                }
+            } catch (...) {
+                destroyObj();
+                throw;
+            }
+        }
+
+        template <typename ... Args>
+        static ControlBlockMakeSharedArray* create(Alloc alloc, size_t n, const Args& ... args) {
+            BlockAlloc blockAlloc(alloc);
+            size_t unitCnt = unitsFor(n);
+            ControlBlockMakeSharedArray* block = BlockAllocTraits::allocate(blockAlloc, unitCnt);
+            try {
+                ::new(block) ControlBlockMakeSharedArray(alloc, unitCnt, n, args...);
+            } catch (...) {
+                BlockAllocTraits::deallocate(blockAlloc, block, unitCnt);
+                throw;
+            }
+            return block;
+        }
+
+        void destroyObj() override {
+            EAlloc allocElem(alloc);
+            for (; cnt > 0; --cnt) {
+                EAllocTraits::destroy(allocElem, elems() + cnt - 1);
+            }
+        }
+
+        void* getObjPtr() override {
+            return elems();
+        }
+
+        void BlockDestruction() override {
+            auto thisPtr = this;
+            size_t unitCnt = units;
+            BlockAlloc allocTmp(std::move(alloc));
+
+            thisPtr->~ControlBlockMakeSharedArray();
+            BlockAllocTraits::deallocate(allocTmp, thisPtr, unitCnt);
+        }
+    };
+
 private:
     BaseControlBlock* blockPtr = nullptr;
-    T* obj = nullptr;
+    element_type* obj = nullptr;
 
 private:
 
+    //adopts a strong reference that was already counted in block
     explicit SharedPtr(BaseControlBlock* block) : blockPtr(block) {
         if (!block) {
             blockPtr = nullptr;
             return;
         }
-        obj = reinterpret_cast<T*>(block->getObjPtr());
-        blockPtr->strongCnt++;
+        obj = static_cast<element_type*>(block->getObjPtr());
+        attached();
+    }
+
+    SharedPtr(BaseControlBlock* block, element_type* ptr) : blockPtr(block), obj(ptr) {
+        attached();
+    }
+
+    void attached() const {
+        RefCountInstrumentation::onAttach(this, blockPtr);
+    }
+
+    void copied() const {
+        RefCountInstrumentation::onCopy(blockPtr);
+        attached();
+    }
+
+    template <typename Y>
+    void movedFrom(const SharedPtr<Y>& that) const {
+        RefCountInstrumentation::onMove(blockPtr);
+        RefCountInstrumentation::onAttach(&that, nullptr);
+        attached();
     }
 
 public:
@@ -126,13 +736,15 @@ public:
     void swap(SharedPtr<T>& that) {
         std::swap(obj, that.obj);
         std::swap(blockPtr, that.blockPtr);
+        attached();
+        that.attached();
     }
 
     template <typename Y,
-            typename Deleter = std::default_delete<Y>,
+            typename Deleter = typename default_deleter_for<Y, T>::type,
             typename Alloc = std::allocator<Y>,
             std::enable_if_t<
-                    std::is_convertible_v<Y*, T*>, bool> = true>
+                    is_adoptable_ptr<Y, T>::value, bool> = true>
     SharedPtr(Y* ptr, Deleter del = Deleter(), Alloc alloc = Alloc()) {
         using ControlBlock = ControlBlockRegular<Y, Deleter, Alloc>;
         using BlockAlloc = typename ControlBlock::BlockAlloc;
@@ -143,26 +755,56 @@ public:
         ::new(regularBlockPtr) ControlBlock(ptr, del, alloc);
         obj = ptr;
         blockPtr = regularBlockPtr;
-        blockPtr->strongCnt++;
+        //an adopted new Y[n] does not tell its length, so its extent is recorded as unknown (0)
+        RefCountInstrumentation::onCreate<Y>(blockPtr, ptr, std::is_array_v<T> ? 0 : sizeof(Y));
+        attached();
+        if constexpr (!std::is_array_v<T>) {
+            linkSharedFromThis(*this, ptr);
+        }
     }
 
+    //shares ownership with owner but points to ptr, usually a part of owner's object
+    template <typename Y>
+    SharedPtr(const SharedPtr<Y>& owner, element_type* ptr) : blockPtr(owner.blockPtr), obj(ptr) {
+        if (blockPtr)
+            blockPtr->incStrong();
+        copied();
+    }
+
+    template <typename Y>
+    SharedPtr(SharedPtr<Y>&& owner, element_type* ptr) noexcept : blockPtr(owner.blockPtr), obj(ptr) {
+        owner.blockPtr = nullptr;
+        owner.obj = nullptr;
+        movedFrom(owner);
+    }
 
-    SharedPtr(const SharedPtr& that) : SharedPtr(that.blockPtr) {}
+
+    SharedPtr(const SharedPtr& that) : blockPtr(that.blockPtr), obj(that.obj) {
+        if (blockPtr)
+            blockPtr->incStrong();
+        copied();
+    }
 
     template <typename Y, std::enable_if_t<
             std::is_convertible_v<Y*, T*>, bool> = true>
     SharedPtr(const SharedPtr<Y>& that) : blockPtr(that.blockPtr), obj(that.obj) {
-        blockPtr->strongCnt++;
+        if (blockPtr)
+            blockPtr->incStrong();
+        copied();
     }
 
     SharedPtr(SharedPtr&& that) noexcept: blockPtr(that.blockPtr), obj(that.obj) {
         that.blockPtr = nullptr;
+        that.obj = nullptr;
+        movedFrom(that);
     }
 
     template <typename Y, std::enable_if_t<
             std::is_convertible_v<Y*, T*>, bool> = true>
     SharedPtr(SharedPtr<Y>&& that) noexcept : blockPtr(that.blockPtr), obj(that.obj) {
         that.blockPtr = nullptr;
+        that.obj = nullptr;
+        movedFrom(that);
     }
 
     SharedPtr& operator=(const SharedPtr& that) {
@@ -190,7 +832,7 @@ public:
     }
 
     size_t use_count() const {
-        return blockPtr ? blockPtr->strongCnt : 0;
+        return blockPtr ? blockPtr->strongCnt.load(std::memory_order_relaxed) : 0;
     }
 
     template <typename Y>
@@ -202,49 +844,257 @@ public:
         if (!blockPtr)
             return;
 
-
-        if (blockPtr->strongCnt == 1) {
-            blockPtr->destroyObj();
-            if (blockPtr->weakCnt == 0) {
-                blockPtr->BlockDestruction();
-                return;
-            }
-        }
-
-        blockPtr->strongCnt--;
+        RefCountInstrumentation::onAttach(this, nullptr);
+        blockPtr->decStrong();
     }
 
-    T* get() const {
+    element_type* get() const {
         return obj;
     }
 
-    T* operator->() const {
+    element_type* operator->() const {
         return get();
     }
 
-    T& operator*() const {
+    element_type& operator*() const {
         return *get();
     }
+
+    template <typename U = T, std::enable_if_t<std::is_array_v<U>, bool> = true>
+    element_type& operator[](std::ptrdiff_t idx) const {
+        return get()[idx];
+    }
 };
 
 template <typename T, typename Alloc, typename... Args>
 SharedPtr<T> allocateShared(Alloc alloc, Args&& ... args) {
-    using ControlBlock = typename SharedPtr<T>::template ControlBlockMakeShared<Alloc>;
-    using BlockAlloc = typename ControlBlock::BlockAlloc;
-    using BlockAllocTraits = typename ControlBlock::BlockAllocTraits;
+    if constexpr (std::is_array_v<T>) {
+        //allocateShared<E[]>(alloc, n, args...) constructs n elements from args
+        using ControlBlock = typename SharedPtr<T>::template ControlBlockMakeSharedArray<Alloc>;
+
+        ControlBlock* blockPtr = ControlBlock::create(alloc, args...);
+        RefCountInstrumentation::onCreate<T>(blockPtr, blockPtr->elems(),
+                                             blockPtr->cnt * sizeof(std::remove_extent_t<T>));
+
+        return SharedPtr<T>(static_cast<BaseControlBlock*>(blockPtr));
+    } else {
+        using ControlBlock = typename SharedPtr<T>::template ControlBlockMakeShared<Alloc>;
+        using BlockAlloc = typename ControlBlock::BlockAlloc;
+        using BlockAllocTraits = typename ControlBlock::BlockAllocTraits;
 
-    BlockAlloc blockAlloc(alloc);
+        BlockAlloc blockAlloc(alloc);
 
-    ControlBlock* blockPtr = BlockAllocTraits::allocate(blockAlloc, 1);
+        ControlBlock* blockPtr = BlockAllocTraits::allocate(blockAlloc, 1);
 
-    ::new(blockPtr) ControlBlock(alloc, std::forward<Args>(args)...);
+        ::new(blockPtr) ControlBlock(alloc, std::forward<Args>(args)...);
+        RefCountInstrumentation::onCreate<T>(blockPtr, blockPtr->getObjPtr(), sizeof(T));
 
-    return SharedPtr<T>(static_cast<BaseControlBlock*>(blockPtr));
+        SharedPtr<T> result(static_cast<BaseControlBlock*>(blockPtr));
+        linkSharedFromThis(result, result.get());
+        return result;
+    }
 }
 
 template <typename T, typename... Args>
 SharedPtr<T> makeShared(Args&& ... args) {
-    return allocateShared<T, std::allocator<T>, Args...>(std::allocator<T>(), std::forward<Args>(args)...);
+    using Alloc = std::allocator<std::remove_extent_t<T>>;
+    return allocateShared<T, Alloc, Args...>(Alloc(), std::forward<Args>(args)...);
+}
+
+//opt-in: the object owned by ptr will be destroyed on DeferredReclaimer's thread
+template <typename T>
+void deferReclamation(const SharedPtr<T>& ptr) {
+    if (ptr.blockPtr)
+        ptr.blockPtr->deferred.store(true, std::memory_order_relaxed);
+}
+
+template <typename T, typename... Args>
+SharedPtr<T> makeSharedDeferred(Args&& ... args) {
+    SharedPtr<T> result = makeShared<T>(std::forward<Args>(args)...);
+    deferReclamation(result);
+    return result;
+}
+
+class SlabPool {
+public:
+    static const size_t GRANULARITY = 16;
+    static const size_t MAX_BLOCK_SIZE = 512;
+    static const size_t CLASS_CNT = MAX_BLOCK_SIZE / GRANULARITY;
+    static const size_t SLAB_SIZE = 64 * 1024;
+    static const size_t BATCH_SIZE = 64;
+
+    struct Stats {
+        size_t slabBytes;
+        size_t centralFreeBytes;
+    };
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FreeList {
+        FreeBlock* head = nullptr;
+        size_t cnt = 0;
+
+        void push(FreeBlock* block) {
+            block->next = head;
+            head = block;
+            ++cnt;
+        }
+
+        FreeBlock* pop() {
+            FreeBlock* block = head;
+            head = head->next;
+            --cnt;
+            return block;
+        }
+
+        //moves up to toMove blocks from the front of this list to the front of that
+        void moveTo(FreeList& that, size_t toMove) {
+            for (size_t i = 0; i < toMove && head; ++i) {
+                that.push(pop());
+            }
+        }
+    };
+
+    //global part: refills thread caches by batches, carves new slabs when empty
+    struct Central {
+        std::mutex mutex;
+        FreeList lists[CLASS_CNT];
+        std::vector<void*> slabs;
+
+        ~Central() {
+            for (void* slab : slabs) {
+                ::operator delete(slab);
+            }
+        }
+    };
+
+    //thread-local part: allocation and deallocation touch only this in the common case
+    struct ThreadCache {
+        FreeList lists[CLASS_CNT];
+
+        ~ThreadCache() {
+            Central& central = centralPool();
+            std::lock_guard<std::mutex> lock(central.mutex);
+            for (size_t i = 0; i < CLASS_CNT; ++i) {
+                lists[i].moveTo(central.lists[i], lists[i].cnt);
+            }
+        }
+    };
+
+    static Central& centralPool() {
+        static Central central;
+        return central;
+    }
+
+    static ThreadCache& threadCache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static size_t classOf(size_t bytes) {
+        return (bytes + GRANULARITY - 1) / GRANULARITY - 1;
+    }
+
+    static void refill(FreeList& local, size_t cls) {
+        Central& central = centralPool();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        FreeList& global = central.lists[cls];
+
+        if (global.cnt == 0) {
+            size_t blockSize = (cls + 1) * GRANULARITY;
+            auto slab = static_cast<uint8_t*>(::operator new(SLAB_SIZE));
+            central.slabs.push_back(slab);
+            for (size_t pos = SLAB_SIZE / blockSize; pos > 0; --pos) {
+                global.push(reinterpret_cast<FreeBlock*>(slab + (pos - 1) * blockSize));
+            }
+        }
+
+        global.moveTo(local, BATCH_SIZE);
+    }
+
+    static void drain(FreeList& local, size_t cls) {
+        Central& central = centralPool();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        local.moveTo(central.lists[cls], BATCH_SIZE);
+    }
+
+public:
+    static void* allocate(size_t bytes, size_t alignment) {
+        if (bytes == 0)
+            bytes = 1;
+        if (bytes > MAX_BLOCK_SIZE || alignment > GRANULARITY)
+            return ::operator new(bytes, std::align_val_t(alignment));
+
+        size_t cls = classOf(bytes);
+        FreeList& local = threadCache().lists[cls];
+        if (local.cnt == 0) {
+            refill(local, cls);
+        }
+        return local.pop();
+    }
+
+    static void deallocate(void* ptr, size_t bytes, size_t alignment) {
+        if (bytes == 0)
+            bytes = 1;
+        if (bytes > MAX_BLOCK_SIZE || alignment > GRANULARITY) {
+            ::operator delete(ptr, std::align_val_t(alignment));
+            return;
+        }
+
+        size_t cls = classOf(bytes);
+        FreeList& local = threadCache().lists[cls];
+        local.push(static_cast<FreeBlock*>(ptr));
+        if (local.cnt >= 2 * BATCH_SIZE) {
+            drain(local, cls);
+        }
+    }
+
+    static Stats stats() {
+        Central& central = centralPool();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        Stats result{central.slabs.size() * SLAB_SIZE, 0};
+        for (size_t i = 0; i < CLASS_CNT; ++i) {
+            result.centralFreeBytes += central.lists[i].cnt * (i + 1) * GRANULARITY;
+        }
+        return result;
+    }
+};
+
+template <typename T>
+struct SlabAllocator {
+    using value_type = T;
+
+    SlabAllocator() = default;
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(SlabPool::allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        SlabPool::deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>&) const {
+        return false;
+    }
+};
+
+template <typename T, typename... Args>
+SharedPtr<T> makeSharedPooled(Args&& ... args) {
+    using Alloc = SlabAllocator<std::remove_extent_t<T>>;
+    return allocateShared<T, Alloc, Args...>(Alloc(), std::forward<Args>(args)...);
 }
 
 
@@ -261,9 +1111,11 @@ class WeakPtr {
 
 private:
     BaseControlBlock* blockPtr = nullptr;
+    std::remove_extent_t<T>* obj = nullptr;
 
-    explicit WeakPtr(BaseControlBlock* block) : blockPtr(block) {
-        blockPtr->weakCnt++;
+    WeakPtr(BaseControlBlock* block, std::remove_extent_t<T>* ptr) : blockPtr(block), obj(ptr) {
+        if (blockPtr)
+            blockPtr->incWeak();
     }
 
 public:
@@ -271,29 +1123,29 @@ public:
 
     void swap(WeakPtr& that) {
         std::swap(blockPtr, that.blockPtr);
+        std::swap(obj, that.obj);
     }
 
     template <class Y, std::enable_if_t<
             std::is_convertible_v<Y*, T*>, bool> = true>
-    WeakPtr(const SharedPtr<Y>& shPtr) : WeakPtr(shPtr.blockPtr) {}
+    WeakPtr(const SharedPtr<Y>& shPtr) : WeakPtr(shPtr.blockPtr, shPtr.obj) {}
 
-    WeakPtr(const WeakPtr& that) : WeakPtr(that.blockPtr) {}
+    WeakPtr(const WeakPtr& that) : WeakPtr(that.blockPtr, that.obj) {}
 
     template <typename Y, std::enable_if_t<
             std::is_convertible_v<Y*, T*>, bool> = true>
-    WeakPtr(const WeakPtr<Y>& that) : blockPtr(that.blockPtr) {
-        blockPtr->weakCnt++;
-    }
+    WeakPtr(const WeakPtr<Y>& that) : WeakPtr(that.blockPtr, that.obj) {}
 
-    WeakPtr(WeakPtr&& that) noexcept: blockPtr(that.blockPtr) {
+    WeakPtr(WeakPtr&& that) noexcept: blockPtr(that.blockPtr), obj(that.obj) {
         that.blockPtr = nullptr;
+        that.obj = nullptr;
     }
 
     template <typename Y, std::enable_if_t<
             std::is_convertible_v<Y*, T*>, bool> = true>
-    WeakPtr(WeakPtr<Y>&& that) noexcept : blockPtr(that.blockPtr) {
-        blockPtr->weakCnt++;
+    WeakPtr(WeakPtr<Y>&& that) noexcept : blockPtr(that.blockPtr), obj(that.obj) {
         that.blockPtr = nullptr;
+        that.obj = nullptr;
     }
 
     WeakPtr& operator=(const WeakPtr& that) {
@@ -328,25 +1180,212 @@ public:
     }
 
     bool expired() const {
-        return !blockPtr || (blockPtr->strongCnt == 0);
+        return !blockPtr || (blockPtr->strongCnt.load(std::memory_order_relaxed) == 0);
     }
 
     SharedPtr<T> lock() const {
-        return expired() ? SharedPtr<T>() : SharedPtr<T>(blockPtr);
+        return (blockPtr && blockPtr->incStrongIfAlive()) ? SharedPtr<T>(blockPtr, obj) : SharedPtr<T>();
     }
 
     ~WeakPtr() {
         if (!blockPtr)
             return;
 
-        blockPtr->weakCnt--;
+        blockPtr->decWeak();
+    }
+
+    size_t use_count() const {
+        return blockPtr ? blockPtr->strongCnt.load(std::memory_order_relaxed) : 0;
+    }
+};
+
+template <typename T>
+class EnableSharedFromThis {
+    template <typename Y, typename U>
+    friend void linkSharedFromThis(const SharedPtr<Y>& owner, const EnableSharedFromThis<U>* base);
+
+    mutable WeakPtr<T> weakThis;
+
+protected:
+    EnableSharedFromThis() = default;
+
+    EnableSharedFromThis(const EnableSharedFromThis&) {}
+
+    EnableSharedFromThis& operator=(const EnableSharedFromThis&) {
+        return *this;
+    }
+
+    ~EnableSharedFromThis() = default;
+
+public:
+    SharedPtr<T> shared_from_this() {
+        SharedPtr<T> result = weakThis.lock();
+        if (!result.get())
+            throw std::bad_weak_ptr();
+        return result;
+    }
+
+    SharedPtr<const T> shared_from_this() const {
+        SharedPtr<const T> result = weakThis.lock();
+        if (!result.get())
+            throw std::bad_weak_ptr();
+        return result;
+    }
+
+    WeakPtr<T> weak_from_this() const {
+        return weakThis;
+    }
+};
+
+template <typename T, typename U>
+void linkSharedFromThis(const SharedPtr<T>& owner, const EnableSharedFromThis<U>* base) {
+    if (base && base->weakThis.expired()) {
+        base->weakThis = SharedPtr<U>(owner, const_cast<U*>(static_cast<const U*>(base)));
+    }
+}
+
+
+template <typename T>
+class AtomicSharedPtr {
+    //split reference count: a reader announces itself in the local count stored next to the pointer,
+    //copies the SharedPtr out of the Holder and takes its announcement back;
+    //a writer that swaps a Holder out moves the local count into Holder::refs,
+    //so late readers settle with the Holder itself and nobody ever takes a lock
+    struct Holder {
+        SharedPtr<T> value;
+        std::atomic<std::ptrdiff_t> refs = 0;
+
+        explicit Holder(SharedPtr<T>&& value) : value(std::move(value)) {}
+    };
+
+    static_assert(sizeof(uintptr_t) == 8, "AtomicSharedPtr packs a 48-bit pointer and a 16-bit count");
+
+    static const uintptr_t COUNT_SHIFT = 48;
+    static const uintptr_t COUNT_ONE = uintptr_t(1) << COUNT_SHIFT;
+    static const uintptr_t PTR_MASK = COUNT_ONE - 1;
+
+    //Holder* in the low 48 bits, number of readers inside it in the high 16 bits
+    mutable std::atomic<uintptr_t> packed;
 
-        if ((blockPtr->strongCnt == 0) && (blockPtr->weakCnt == 0)) {
-            blockPtr->BlockDestruction();
+private:
+    static Holder* holderOf(uintptr_t word) {
+        return reinterpret_cast<Holder*>(word & PTR_MASK);
+    }
+
+    static std::ptrdiff_t countOf(uintptr_t word) {
+        return static_cast<std::ptrdiff_t>(word >> COUNT_SHIFT);
+    }
+
+    static uintptr_t pack(SharedPtr<T>&& value) {
+        if (!value.blockPtr)
+            return 0;
+        return reinterpret_cast<uintptr_t>(new Holder(std::move(value)));
+    }
+
+    static void settle(Holder* holder, std::ptrdiff_t delta) {
+        if (holder && holder->refs.fetch_add(delta, std::memory_order_acq_rel) + delta == 0) {
+            delete holder;
         }
     }
 
-    size_t use_count() const {
-        return blockPtr ? blockPtr->strongCnt : 0;
+    Holder* acquire() const {
+        return holderOf(packed.fetch_add(COUNT_ONE, std::memory_order_acquire));
+    }
+
+    void release(Holder* holder) const {
+        uintptr_t word = packed.load(std::memory_order_relaxed);
+        while (holderOf(word) == holder) {
+            if (packed.compare_exchange_weak(word, word - COUNT_ONE,
+                                             std::memory_order_release, std::memory_order_relaxed))
+                return;
+        }
+        //holder was swapped out and our announcement went to holder->refs
+        settle(holder, -1);
+    }
+
+    static bool holds(Holder* holder, const SharedPtr<T>& ptr) {
+        if (!holder)
+            return !ptr.blockPtr && !ptr.obj;
+        return holder->value.blockPtr == ptr.blockPtr && holder->value.obj == ptr.obj;
+    }
+
+public:
+    AtomicSharedPtr() : packed(0) {}
+
+    AtomicSharedPtr(SharedPtr<T> desired) : packed(pack(std::move(desired))) {}
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    ~AtomicSharedPtr() {
+        uintptr_t word = packed.load(std::memory_order_acquire);
+        settle(holderOf(word), countOf(word));
+    }
+
+    bool is_lock_free() const {
+        return packed.is_lock_free();
+    }
+
+    SharedPtr<T> load() const {
+        Holder* holder = acquire();
+        SharedPtr<T> result = holder ? holder->value : SharedPtr<T>();
+        release(holder);
+        return result;
+    }
+
+    operator SharedPtr<T>() const {
+        return load();
+    }
+
+    SharedPtr<T> exchange(SharedPtr<T> desired) {
+        uintptr_t old = packed.exchange(pack(std::move(desired)), std::memory_order_acq_rel);
+        Holder* holder = holderOf(old);
+        if (!holder)
+            return SharedPtr<T>();
+
+        //readers may still be copying holder->value, so it can not be moved out
+        SharedPtr<T> result = holder->value;
+        settle(holder, countOf(old));
+        return result;
+    }
+
+    void store(SharedPtr<T> desired) {
+        exchange(std::move(desired));
+    }
+
+    AtomicSharedPtr& operator=(SharedPtr<T> desired) {
+        store(std::move(desired));
+        return *this;
+    }
+
+    bool compare_exchange_strong(SharedPtr<T>& expected, SharedPtr<T> desired) {
+        uintptr_t fresh = pack(std::move(desired));
+
+        while (true) {
+            Holder* holder = acquire();
+
+            if (!holds(holder, expected)) {
+                expected = holder ? holder->value : SharedPtr<T>();
+                release(holder);
+                settle(holderOf(fresh), 0);
+                return false;
+            }
+
+            uintptr_t word = packed.load(std::memory_order_relaxed);
+            while (holderOf(word) == holder) {
+                if (packed.compare_exchange_weak(word, fresh, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    //our own announcement is inside countOf(word) and is dropped right here
+                    settle(holder, countOf(word) - 1);
+                    return true;
+                }
+            }
+
+            release(holder);
+        }
+    }
+
+    bool compare_exchange_weak(SharedPtr<T>& expected, SharedPtr<T> desired) {
+        return compare_exchange_strong(expected, std::move(desired));
     }
 };
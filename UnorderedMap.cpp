@@ -2,6 +2,339 @@
 #include <vector>
 #include <cstddef>
 #include <cmath>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+//fixed-size blocks with a free list per block size, memory goes back to the pool on deallocate
+class PoolStorage {
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct FixedPool {
+        size_t blockSize;
+        FreeBlock* freeList = nullptr;
+        size_t nextChunkBlocks = FIRST_CHUNK_BLOCKS;
+    };
+
+    static constexpr size_t FIRST_CHUNK_BLOCKS = 32;
+    static constexpr size_t MAX_CHUNK_BLOCKS = 4096;
+
+    std::vector<FixedPool> pools;
+    std::vector<void*> chunks;
+
+    static size_t blockSizeFor(size_t toAlloc, size_t allignment) {
+        size_t step = std::max(allignment, alignof(FreeBlock));
+        return (std::max(toAlloc, sizeof(FreeBlock)) + step - 1) / step * step;
+    }
+
+    FixedPool& poolFor(size_t blockSize) {
+        for (FixedPool& pool : pools) {
+            if (pool.blockSize == blockSize)
+                return pool;
+        }
+        pools.push_back(FixedPool{blockSize});
+        return pools.back();
+    }
+
+    void grow(FixedPool& pool) {
+        auto chunk = static_cast<uint8_t*>(::operator new(pool.blockSize * pool.nextChunkBlocks));
+        chunks.push_back(chunk);
+        for (size_t i = pool.nextChunkBlocks; i > 0; --i) {
+            auto block = reinterpret_cast<FreeBlock*>(chunk + (i - 1) * pool.blockSize);
+            block->next = pool.freeList;
+            pool.freeList = block;
+        }
+        pool.nextChunkBlocks = std::min(2 * pool.nextChunkBlocks, MAX_CHUNK_BLOCKS);
+    }
+
+public:
+    PoolStorage() = default;
+
+    PoolStorage(const PoolStorage&) = delete;
+
+    PoolStorage& operator=(const PoolStorage&) = delete;
+
+    ~PoolStorage() {
+        for (void* chunk : chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* alloc(size_t toAlloc, size_t allignment = 1) {
+        if (allignment > alignof(std::max_align_t))
+            return ::operator new(toAlloc, std::align_val_t(allignment));
+
+        FixedPool& pool = poolFor(blockSizeFor(toAlloc, allignment));
+        if (!pool.freeList) {
+            grow(pool);
+        }
+        FreeBlock* block = pool.freeList;
+        pool.freeList = block->next;
+        return block;
+    }
+
+    void dealloc(void* ptr, size_t toDealloc, size_t allignment = 1) {
+        if (allignment > alignof(std::max_align_t)) {
+            ::operator delete(ptr, std::align_val_t(allignment));
+            return;
+        }
+
+        FixedPool& pool = poolFor(blockSizeFor(toDealloc, allignment));
+        auto block = static_cast<FreeBlock*>(ptr);
+        block->next = pool.freeList;
+        pool.freeList = block;
+    }
+};
+
+
+template <typename T>
+class PoolAllocator {
+    template <typename U>
+    friend
+    class PoolAllocator;
+
+private:
+    //shared by all copies and rebinds, so nodes may be freed through any of them
+    std::shared_ptr<PoolStorage> storage;
+
+public:
+    PoolAllocator() : storage(std::make_shared<PoolStorage>()) {}
+
+    PoolAllocator(const PoolAllocator& that) = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& that) : storage(that.storage) {}
+
+    PoolAllocator& operator=(const PoolAllocator& that) = default;
+
+    ~PoolAllocator() = default;
+
+
+    T* allocate(size_t toAlloc) {
+        //arrays (e.g. bucket vectors) are not pooled, only single nodes are
+        if (toAlloc != 1)
+            return static_cast<T*>(::operator new(sizeof(T) * toAlloc, std::align_val_t(alignof(T))));
+        return reinterpret_cast<T*>(storage->alloc(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_t toDealloc) {
+        if (toDealloc != 1) {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+            return;
+        }
+        storage->dealloc(ptr, sizeof(T), alignof(T));
+    }
+
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U>;
+    };
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& that) const {
+        return storage == that.storage;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& that) const {
+        return storage != that.storage;
+    }
+};
+
+//per-thread arena: allocation and same-thread frees touch only thread-owned lists,
+//blocks freed by other threads come back through a lock-free MPSC stack
+class ThreadArena {
+public:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 256;
+    static constexpr size_t CLASS_CNT = MAX_BLOCK_SIZE / GRANULARITY;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    //every block starts with its owner and size class, so any thread can route a free back to it
+    struct alignas(GRANULARITY) BlockHeader {
+        ThreadArena* owner;
+        size_t cls;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* freeLists[CLASS_CNT] = {};
+    std::atomic<FreeBlock*> remoteFrees{nullptr};
+    std::vector<void*> chunks;
+
+    //an arena outlives its thread: on thread exit it is parked here and adopted by the next new thread,
+    //so blocks still in use elsewhere stay valid
+    struct Abandoned {
+        std::mutex mutex;
+        std::vector<ThreadArena*> arenas;
+    };
+
+    static Abandoned& abandoned() {
+        static Abandoned list;
+        return list;
+    }
+
+    struct Holder {
+        ThreadArena* arena;
+
+        Holder() {
+            Abandoned& list = abandoned();
+            std::lock_guard<std::mutex> lock(list.mutex);
+            if (list.arenas.empty()) {
+                arena = new ThreadArena();
+            } else {
+                arena = list.arenas.back();
+                list.arenas.pop_back();
+            }
+        }
+
+        ~Holder() {
+            Abandoned& list = abandoned();
+            std::lock_guard<std::mutex> lock(list.mutex);
+            list.arenas.push_back(arena);
+        }
+    };
+
+    static size_t classOf(size_t bytes) {
+        return (std::max(bytes, size_t(1)) + GRANULARITY - 1) / GRANULARITY - 1;
+    }
+
+    static size_t slotSize(size_t cls) {
+        return sizeof(BlockHeader) + (cls + 1) * GRANULARITY;
+    }
+
+    static BlockHeader* headerOf(void* ptr) {
+        return reinterpret_cast<BlockHeader*>(ptr) - 1;
+    }
+
+    void grow(size_t cls) {
+        auto chunk = static_cast<uint8_t*>(::operator new(CHUNK_SIZE));
+        chunks.push_back(chunk);
+        size_t slot = slotSize(cls);
+        for (size_t pos = CHUNK_SIZE / slot; pos > 0; --pos) {
+            auto header = reinterpret_cast<BlockHeader*>(chunk + (pos - 1) * slot);
+            header->owner = this;
+            header->cls = cls;
+            pushLocal(reinterpret_cast<FreeBlock*>(header + 1), cls);
+        }
+    }
+
+    void pushLocal(FreeBlock* block, size_t cls) {
+        block->next = freeLists[cls];
+        freeLists[cls] = block;
+    }
+
+    //remote frees are sorted into local lists only by the owner
+    void collectRemote() {
+        FreeBlock* block = remoteFrees.exchange(nullptr, std::memory_order_acquire);
+        while (block) {
+            FreeBlock* next = block->next;
+            pushLocal(block, headerOf(block)->cls);
+            block = next;
+        }
+    }
+
+    void pushRemote(FreeBlock* block) {
+        block->next = remoteFrees.load(std::memory_order_relaxed);
+        while (!remoteFrees.compare_exchange_weak(block->next, block,
+                                                  std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    ThreadArena() = default;
+
+public:
+    ThreadArena(const ThreadArena&) = delete;
+
+    ThreadArena& operator=(const ThreadArena&) = delete;
+
+    static ThreadArena& current() {
+        thread_local Holder holder;
+        return *holder.arena;
+    }
+
+    void* alloc(size_t toAlloc) {
+        if (toAlloc > MAX_BLOCK_SIZE) {
+            auto header = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + toAlloc));
+            header->owner = nullptr;
+            return header + 1;
+        }
+
+        size_t cls = classOf(toAlloc);
+        if (!freeLists[cls]) {
+            collectRemote();
+        }
+        if (!freeLists[cls]) {
+            grow(cls);
+        }
+        FreeBlock* block = freeLists[cls];
+        freeLists[cls] = block->next;
+        return block;
+    }
+
+    void dealloc(void* ptr) {
+        BlockHeader* header = headerOf(ptr);
+        if (!header->owner) {
+            ::operator delete(header);
+            return;
+        }
+
+        auto block = static_cast<FreeBlock*>(ptr);
+        if (header->owner == this) {
+            pushLocal(block, header->cls);
+        } else {
+            header->owner->pushRemote(block);
+        }
+    }
+};
+
+
+template <typename T>
+class ThreadArenaAllocator {
+public:
+    using value_type = T;
+
+    //all state is in ThreadArena::current(), so every instance is interchangeable
+    using is_always_equal = std::true_type;
+
+    ThreadArenaAllocator() = default;
+
+    template <typename U>
+    ThreadArenaAllocator(const ThreadArenaAllocator<U>&) {}
+
+    T* allocate(size_t toAlloc) {
+        static_assert(alignof(T) <= ThreadArena::GRANULARITY, "over-aligned types are not supported");
+        return static_cast<T*>(ThreadArena::current().alloc(sizeof(T) * toAlloc));
+    }
+
+    void deallocate(T* ptr, size_t) {
+        ThreadArena::current().dealloc(ptr);
+    }
+
+    template <typename U>
+    struct rebind {
+        using other = ThreadArenaAllocator<U>;
+    };
+
+    template <typename U>
+    bool operator==(const ThreadArenaAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ThreadArenaAllocator<U>&) const {
+        return false;
+    }
+};
 
 template <typename T, typename Allocator = std::allocator<T>>
 class List {
@@ -79,6 +412,12 @@ private:
         NodeAllocatorTraits::deallocate(nodeAlloc, toDel, 1);
     }
 
+    //takes over all nodes of that, this has to be empty
+    void steal(List& that) noexcept {
+        fakeNode.swap(that.fakeNode);
+        std::swap(sz, that.sz);
+    }
+
     void insertNode(baseNode* pos, baseNode* toIns) {
         pos->prev->link(toIns);
         toIns->link(pos);
@@ -231,22 +570,37 @@ public:
     }
 
 
-    List(List&& that) noexcept {
-        fakeNode.swap(that.fakeNode);
-        nodeAlloc = std::move(that.nodeAlloc);
-        alloc = std::move(that.alloc);
-        sz = that.sz;
-        that.sz = 0;
+    //the allocator is copied, not default-constructed, so the moved-from list can still make nodes
+    List(List&& that) noexcept :
+            nodeAlloc(that.nodeAlloc), alloc(that.alloc) {
+        steal(that);
     }
 
-    List& operator=(List&& that) noexcept {
-        NodeAllocator newAlloc = std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value
-                                 ? std::move(that.alloc) : alloc;
-        List<T, Allocator> tmp(newAlloc);
+    //O(1) when the allocator propagates or both are equal, element-wise into our own nodes otherwise
+    List& operator=(List&& that) noexcept(std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+                                          std::allocator_traits<Allocator>::is_always_equal::value) {
+        if (this == &that)
+            return *this;
 
-        tmp.fakeNode.swap(that.fakeNode);
+        if constexpr (!std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value &&
+                      !std::allocator_traits<Allocator>::is_always_equal::value) {
+            if (alloc != that.alloc) {
+                List tmp(alloc);
+                for (T& val : that) {
+                    tmp.emplace_back(std::move(val));
+                }
+                clear();
+                steal(tmp);
+                return *this;
+            }
+        }
 
-        this->swap(tmp);
+        clear();
+        if constexpr (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value) {
+            nodeAlloc = that.nodeAlloc;
+            alloc = that.alloc;
+        }
+        steal(that);
         return *this;
     }
 
@@ -427,8 +781,8 @@ private:
     }
 
     void rehash(size_t newPtrSize) {
+        //the moved-from list keeps the map's allocator, so the nodes can be relinked into it
         MapList copy(std::move(elements));
-        elements = MapList();
         pointers.assign(newPtrSize, nullptr);
 
         auto next(copy.begin());
@@ -501,7 +855,7 @@ public:
             allocator(
                     std::allocator_traits<Alloc>::select_on_container_copy_construction(
                             that.allocator)),
-            elements(), pointers(DEFAULT_CAPACITY, nullptr, allocator),
+            elements(allocator), pointers(DEFAULT_CAPACITY, nullptr, allocator),
             maxLoadFactor(that.maxLoadFactor) {
         try {
             for (auto e : that) {
@@ -1,53 +1,71 @@
 struct out_of_range_type {};
 
-template <size_t Index, typename ... Tail>
-struct get_type_by_index {
+//every alternative is a distinct base tagged with its index, so picking one is a single overload resolution
+//instead of a chain of Index instantiations
+template <size_t Index, typename T>
+struct indexed_type {
+    using type = T;
+};
+
+template <typename Indices, typename ... Ts>
+struct indexed_types;
+
+template <size_t ... Is, typename ... Ts>
+struct indexed_types<std::index_sequence<Is...>, Ts...> : indexed_type<Is, Ts>... {};
+
+template <size_t Index, typename T>
+indexed_type<Index, T> select_indexed(const indexed_type<Index, T>&);
+
+template <bool InRange, size_t Index, typename ... Ts>
+struct get_type_by_index_impl {
     using type = out_of_range_type;
 };
 
-template <size_t Index, typename Head, typename ... Tail>
-struct get_type_by_index<Index, Head, Tail...> {
-    using type = std::conditional_t<Index == 0, Head, typename get_type_by_index<Index - 1, Tail...>::type>;
+template <size_t Index, typename ... Ts>
+struct get_type_by_index_impl<true, Index, Ts...> {
+    using type = typename decltype(select_indexed<Index>(
+            std::declval<indexed_types<std::index_sequence_for<Ts...>, Ts...>>()))::type;
+};
+
+template <size_t Index, typename ... Ts>
+struct get_type_by_index {
+    using type = typename get_type_by_index_impl<(Index < sizeof...(Ts)), Index, Ts...>::type;
 };
 
 template <size_t Index, typename ... Ts>
 using get_type_by_index_t = typename get_type_by_index<Index, Ts...>::type;
 
 
-template <typename T, typename ... Tail>
-struct get_index_by_type {
-    static const size_t value = 0;
-};
+//index of the first T among Ts, sizeof...(Ts) if there is none
+template <typename T, typename ... Ts>
+constexpr size_t find_type_index() {
+    bool same[] = {std::is_same_v<T, Ts>..., false};
+    for (size_t i = 0; i < sizeof...(Ts); ++i) {
+        if (same[i])
+            return i;
+    }
+    return sizeof...(Ts);
+}
 
-template <typename T, typename Head, typename ... Tail>
-struct get_index_by_type<T, Head, Tail...> {
-    static const size_t value = std::is_same_v<T, Head> ? 0 : 1 + get_index_by_type<T, Tail...>::value;
+template <typename T, typename ... Ts>
+struct get_index_by_type {
+    static const size_t value = find_type_index<T, Ts...>();
 };
 
 template <typename T, typename ... Ts>
 static const size_t get_index_by_type_v = get_index_by_type<T, Ts...>::value;
 
-template <typename ... Tail>
+template <typename ... Ts>
 struct count_types {
-    static const size_t value = 0;
-};
-
-template <typename Head, typename ... Tail>
-struct count_types<Head, Tail...> {
-    static const size_t value = 1 + count_types<Tail...>::value;
+    static const size_t value = sizeof...(Ts);
 };
 
 template <typename ... Ts>
 static const size_t count_types_v = count_types<Ts...>::value;
 
-template <typename T, typename ... Tail>
+template <typename T, typename ... Ts>
 struct count_occurrences_of_type {
-    static const size_t value = 0;
-};
-
-template <typename T, typename Head, typename ... Tail>
-struct count_occurrences_of_type<T, Head, Tail...> {
-    static const size_t value = std::is_same_v<T, Head> + count_occurrences_of_type<T, Tail...>::value;
+    static const size_t value = (std::is_same_v<T, Ts> + ... + 0);
 };
 
 template <typename ... Ts>
@@ -59,24 +77,31 @@ static const size_t count_occurrences_of_type_v = count_occurrences_of_type<Ts..
 template <typename T>
 struct identity { using type = T; };
 
-template <typename... Ts> struct overload;
-
-template <> struct overload<> { void operator()() const; };
-
-template <typename T, typename... Ts>
-struct overload<T, Ts...> : overload<Ts...> {
-    using overload<Ts...>::operator();
+template <size_t Index, typename T>
+struct overload_alternative {
     identity<T> operator()(T) const;
 };
 
 // void is a valid variant alternative, but "T operator()(T)" is ill-formed
 // when T is void
-template <typename... Ts>
-struct overload<void, Ts...> : overload<Ts...> {
-    using overload<Ts...>::operator();
+template <size_t Index>
+struct overload_alternative<Index, void> {
     identity<void> operator()() const;
 };
 
+//one flat set of bases brought in by a single pack using-declaration, rather than a chain of
+//classes each re-exporting the operator() of the one below
+template <typename Indices, typename ... Ts>
+struct overload_set;
+
+template <size_t ... Is, typename ... Ts>
+struct overload_set<std::index_sequence<Is...>, Ts...> : overload_alternative<Is, Ts>... {
+    using overload_alternative<Is, Ts>::operator()...;
+};
+
+template <typename ... Ts>
+struct overload : overload_set<std::index_sequence_for<Ts...>, Ts...> {};
+
 
 template <typename T, typename ... Ts>
 using best_conversion_t = typename std::result_of_t<overload<Ts...>(T)>::type;
@@ -95,6 +120,99 @@ class VariantAlternative;
 template <typename ... Ts>
 class Variant;
 
+template <typename V>
+struct variant_size;
+
+template <typename ... Ts>
+struct variant_size<Variant<Ts...>> {
+    static const size_t value = sizeof...(Ts);
+};
+
+template <typename V>
+static const size_t variant_size_v = variant_size<std::remove_cv_t<std::remove_reference_t<V>>>::value;
+
+//unchecked access to the alternative at Index, keeps the value category of the variant
+struct VariantAccess {
+    template <size_t Index, typename V>
+    static decltype(auto) get(V&& variant) {
+        return std::remove_cv_t<std::remove_reference_t<V>>::template member<Index>(std::forward<V>(variant).storage);
+    }
+};
+
+template <typename Visitor, typename Indices>
+struct IndexJumpTable;
+
+template <typename Visitor, size_t ... Is>
+struct IndexJumpTable<Visitor, std::index_sequence<Is...>> {
+    using Result = decltype(std::declval<Visitor>()(std::integral_constant<size_t, 0>()));
+
+    template <size_t Index>
+    static Result dispatch(Visitor&& visitor) {
+        return std::forward<Visitor>(visitor)(std::integral_constant<size_t, Index>());
+    }
+
+    static constexpr Result (* table[])(Visitor&&) = {&dispatch<Is>...};
+};
+
+//below this many alternatives a chain of inlined comparisons beats an indirect call
+static const size_t VISIT_TABLE_THRESHOLD = 5;
+
+template <size_t Index, size_t Count, typename Visitor>
+decltype(auto) visit_index_linear(Visitor&& visitor, size_t index) {
+    if constexpr (Index + 1 == Count) {
+        return std::forward<Visitor>(visitor)(std::integral_constant<size_t, Index>());
+    } else {
+        if (index == Index) {
+            return std::forward<Visitor>(visitor)(std::integral_constant<size_t, Index>());
+        }
+        return visit_index_linear<Index + 1, Count>(std::forward<Visitor>(visitor), index);
+    }
+}
+
+//calls visitor(std::integral_constant<size_t, index>()) through a function pointer table built at compile time,
+//so dispatch costs one indirect call whatever Count is
+template <size_t Count, typename Visitor>
+decltype(auto) visit_index(Visitor&& visitor, size_t index) {
+    if constexpr (Count < VISIT_TABLE_THRESHOLD) {
+        return visit_index_linear<0, Count>(std::forward<Visitor>(visitor), index);
+    } else {
+        using Table = IndexJumpTable<Visitor, std::make_index_sequence<Count>>;
+        return Table::table[index](std::forward<Visitor>(visitor));
+    }
+}
+
+//how many combined indices one step of the K-th variant's index is worth
+template <size_t K, typename ... Variants>
+constexpr size_t visit_stride() {
+    size_t sizes[] = {variant_size_v<Variants>...};
+    size_t stride = 1;
+    for (size_t i = K + 1; i < sizeof...(Variants); ++i) {
+        stride *= sizes[i];
+    }
+    return stride;
+}
+
+template <typename Visitor, typename ... Variants, size_t ... K>
+decltype(auto) visit_impl(std::index_sequence<K...>, Visitor&& visitor, Variants&& ... variants) {
+    //several variants are flattened into one index of a table with the product of their sizes
+    size_t flat = ((variants.index() * visit_stride<K, Variants...>()) + ... + 0);
+
+    return visit_index<(variant_size_v<Variants> * ... * 1)>([&](auto flatIndex) -> decltype(auto) {
+        constexpr size_t Flat = decltype(flatIndex)::value;
+        return std::invoke(std::forward<Visitor>(visitor), VariantAccess::get<
+                Flat / visit_stride<K, Variants...>() % variant_size_v<Variants>>(std::forward<Variants>(variants))...);
+    }, flat);
+}
+
+template <typename Visitor, typename ... Variants>
+decltype(auto) visit(Visitor&& visitor, Variants&& ... variants) {
+    if ((variants.valueless_by_exception() || ...)) {
+        throw std::logic_error("visiting a valueless variant");
+    }
+    return visit_impl(std::index_sequence_for<Variants...>(), std::forward<Visitor>(visitor),
+                      std::forward<Variants>(variants)...);
+}
+
 template <typename T, typename ...Ts>
 bool holds_alternative(const Variant<Ts...>& variant) {
     return variant.index() == get_index_by_type_v<T, Ts...>;
@@ -109,7 +227,7 @@ T& get(Variant<Ts...>& variant) {
         throw std::logic_error("you picked the wrong house, fool");
     }
 
-    return variant.storage.template get<index_to_get>();
+    return VariantAccess::get<index_to_get>(variant);
 }
 
 template <typename T, typename ... Ts>
@@ -121,7 +239,7 @@ const T& get(const Variant<Ts...>& variant) {
         throw std::logic_error("you picked the wrong house, fool");
     }
 
-    return variant.storage.template get<index_to_get>();
+    return VariantAccess::get<index_to_get>(variant);
 }
 
 template <typename T, typename ... Ts>
@@ -133,7 +251,7 @@ T&& get(Variant<Ts...>&& variant) {
         throw std::logic_error("you picked the wrong house, fool");
     }
 
-    return std::move(variant).storage.template get<index_to_get>();
+    return VariantAccess::get<index_to_get>(std::move(variant));
 }
 
 template <size_t Index, typename ... Ts>
@@ -151,8 +269,82 @@ auto&& get(Variant<Ts...>&& variant) {
     return get<get_type_by_index_t<Index, Ts...>, Ts...>(std::move(variant));
 }
 
+//a type may declare object representations that no valid value of it has: count of them,
+//set(storage, n) writes the n-th one, get(storage) returns n, or count if storage holds a real value
+template <typename T>
+struct variant_niche {
+    static const size_t count = 0;
+};
+
+template <>
+struct variant_niche<bool> {
+    static const size_t count = 254;
+
+    static void set(void* storage, size_t n) {
+        *static_cast<unsigned char*>(storage) = static_cast<unsigned char>(2 + n);
+    }
+
+    static size_t get(const void* storage) {
+        unsigned char byte = *static_cast<const unsigned char*>(storage);
+        return byte < 2 ? count : byte - 2;
+    }
+};
+
+//the smallest unsigned type holding every index plus the valueless one
+template <size_t Count>
+using variant_index_t = std::conditional_t<(Count < 256), unsigned char,
+        std::conditional_t<(Count < 65536), unsigned short, unsigned int>>;
+
 template <typename ... Ts>
-class VariantStorage {
+struct VariantLayout {
+    //index of the only alternative that is not an empty class, sizeof...(Ts) if there is no such single one
+    static constexpr size_t nonEmptyIndex() {
+        bool empty[] = {std::is_empty_v<Ts>...};
+        size_t found = sizeof...(Ts);
+        for (size_t i = 0; i < sizeof...(Ts); ++i) {
+            if (!empty[i]) {
+                if (found != sizeof...(Ts))
+                    return sizeof...(Ts);
+                found = i;
+            }
+        }
+        return found;
+    }
+
+    static constexpr size_t NICHE_OWNER = nonEmptyIndex();
+    using Niche = variant_niche<std::remove_cv_t<get_type_by_index_t<NICHE_OWNER, Ts...>>>;
+
+    //the index goes into the owner's spare representations if they cover every other alternative and valueless
+    static constexpr bool USE_NICHE = NICHE_OWNER < sizeof...(Ts) && Niche::count >= sizeof...(Ts);
+};
+
+template <typename ... Ts>
+struct VariantTraits {
+    static constexpr bool TRIVIAL_DESTRUCTOR = (std::is_trivially_destructible_v<Ts> && ...);
+    static constexpr bool TRIVIAL_COPY = TRIVIAL_DESTRUCTOR && (std::is_trivially_copy_constructible_v<Ts> && ...);
+    static constexpr bool TRIVIAL_MOVE = TRIVIAL_DESTRUCTOR && (std::is_trivially_move_constructible_v<Ts> && ...);
+    static constexpr bool TRIVIAL_COPY_ASSIGN = TRIVIAL_COPY && (std::is_trivially_copy_assignable_v<Ts> && ...);
+    static constexpr bool TRIVIAL_MOVE_ASSIGN = TRIVIAL_MOVE && (std::is_trivially_move_assignable_v<Ts> && ...);
+
+    static constexpr bool NOTHROW_COPY = (std::is_nothrow_copy_constructible_v<Ts> && ...);
+    static constexpr bool NOTHROW_MOVE = (std::is_nothrow_move_constructible_v<Ts> && ...);
+
+    //a replacement that may throw is built aside and moved in, so when no move throws the variant
+    //is never left valueless and valueless_by_exception() is a constant
+    static constexpr bool NEVER_VALUELESS = NOTHROW_MOVE;
+};
+
+//keeps index + 1, so valueless is 0 and index() is a plain subtraction that wraps to -1
+template <bool UseNiche, size_t Count>
+struct VariantTag {
+    variant_index_t<Count> index_ = 0;
+};
+
+template <size_t Count>
+struct VariantTag<true, Count> {};
+
+template <typename ... Ts>
+class VariantStorage : private VariantTag<VariantLayout<Ts...>::USE_NICHE, sizeof...(Ts)> {
     template <typename ... Types>
     friend
     class Variant;
@@ -161,91 +353,300 @@ class VariantStorage {
     friend
     class VariantAlternative;
 
-    template <typename T, typename ... Types>
-    friend T& get(Variant<Types...>&);
-
-    template <typename T, typename ... Types>
-    friend const T& get(const Variant<Types...>&);
+    friend struct VariantAccess;
 
-    template <typename T, typename ... Types>
-    friend T&& get(Variant<Types...>&&);
+    friend struct VariantCodec;
 
 
-    template <typename ... Types>
+    //a union whose members have non-trivial destructors must declare its own, which is then never trivial,
+    //so there are two flavours, and the members are reached through the helpers below that fit both
+    template <bool TriviallyDestructible, typename ... Types>
     union VariadicUnion {
     };
 
     template <typename Head, typename ... Tail>
-    union VariadicUnion<Head, Tail...> {
+    union VariadicUnion<true, Head, Tail...> {
+        Head head;
+        VariadicUnion<true, Tail...> tail;
+
+        VariadicUnion() {}
+    };
+
+    template <typename Head, typename ... Tail>
+    union VariadicUnion<false, Head, Tail...> {
         Head head;
-        VariadicUnion<Tail...> tail;
+        VariadicUnion<false, Tail...> tail;
 
         VariadicUnion() {}
 
         ~VariadicUnion() {}
+    };
 
-        template <size_t Index>
-        auto& get()& {
-            if constexpr (Index == 0) {
-                return head;
-            } else {
-                return tail.template get<Index - 1>();
-            }
+    //every member of the nested unions starts at the union's own address, so any alternative is one cast away
+    //instead of a walk down Index levels of tails
+    template <size_t Index, typename Union>
+    static decltype(auto) member(Union&& u) {
+        using T = get_type_by_index_t<Index, Ts...>;
+        using Pointer = std::conditional_t<std::is_const_v<std::remove_reference_t<Union>>, const T*, T*>;
+        Pointer ptr = std::launder(reinterpret_cast<Pointer>(&u));
+        if constexpr (std::is_lvalue_reference_v<Union>) {
+            return *ptr;
+        } else {
+            return std::move(*ptr);
         }
+    }
 
-        template <size_t Index>
-        auto&& get()&& {
-            if constexpr (Index == 0) {
-                return std::move(head);
-            } else {
-                return std::move(tail.template get<Index - 1>());
-            }
+    template <typename T, typename Union, typename ... Args>
+    static void construct(Union& u, Args&& ... args) {
+        new(static_cast<void*>(&u)) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T, typename Union>
+    static void destruct(Union& u) {
+        member<get_index_by_type_v<T, Ts...>>(u).~T();
+    }
+
+    using Layout = VariantLayout<Ts...>;
+
+    static const size_t EMPTYINDEX = -1;
+
+    VariadicUnion<(std::is_trivially_destructible_v<Ts> && ...), Ts...> storage;
+
+    template <typename T, typename ... Args>
+    void put(Args&& ... args) {
+        construct<T>(storage, std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void destroy() {
+        destruct<T>(storage);
+    }
+
+    //with a niche the owner takes index count, the other alternatives and valueless are packed in order
+    void setIndex(size_t index) {
+        if constexpr (Layout::USE_NICHE) {
+            if (index == Layout::NICHE_OWNER)
+                return;
+            size_t niche = index == EMPTYINDEX ? sizeof...(Ts) - 1 : index - (index > Layout::NICHE_OWNER);
+            Layout::Niche::set(&storage, niche);
+        } else {
+            this->index_ = static_cast<variant_index_t<sizeof...(Ts)>>(index + 1);
         }
+    }
 
-        template <size_t Index>
-        const auto& get() const& {
-            if constexpr (Index == 0) {
-                return head;
-            } else {
-                return tail.template get<Index - 1>();
-            }
+protected:
+    //a constructor that throws still runs clear() through the destructors of the bases,
+    //so this looks at the stored index even when valueless_by_exception() is constant
+    bool holdsValue() const {
+        if constexpr (Layout::USE_NICHE) {
+            return index() != EMPTYINDEX;
+        } else {
+            return this->index_ != 0;
         }
+    }
 
-        template <typename T, typename ... Args>
-        void put(Args&& ... args) {
-            if constexpr (std::is_same_v<T, Head>) {
-                new(std::launder(const_cast<std::remove_const_t<Head>*>(&head))) T(std::forward<Args>(args)...);
-            } else {
-                tail.template put<T>(std::forward<Args>(args)...);
-            }
+    void clear() {
+        if (holdsValue()) {
+            visit_index<sizeof...(Ts)>([this](auto index) {
+                destroy<get_type_by_index_t<decltype(index)::value, Ts...>>();
+            }, index());
         }
+        mark_valueless();
+    }
 
-        template <typename T>
-        void destroy() {
-            if constexpr (std::is_same_v<T, Head>) {
-                head.~Head();
-            } else {
-                tail.template destroy<T>();
-            }
+    //builds a copy of the alternative held by that, which must not be valueless
+    template <typename Other>
+    void constructFrom(Other&& that) {
+        try {
+            visit_index<sizeof...(Ts)>([this, &that](auto index) {
+                constexpr size_t Index = decltype(index)::value;
+                put<get_type_by_index_t<Index, Ts...>>(VariantAccess::get<Index>(std::forward<Other>(that)));
+            }, that.index());
+        } catch (...) {
+            mark_valueless();
+            throw;
         }
-    };
+        setIndex(that.index());
+    }
 
+    void mark_valueless() {
+        setIndex(EMPTYINDEX);
+    }
 
-    static const size_t EMPTYINDEX = -1;
+    //destroys the held alternative and constructs the one at Index from args in its place;
+    //only a type that neither constructs from args nor moves without throwing can end up valueless
+    template <size_t Index, typename ... Args>
+    void replace(Args&& ... args) {
+        using T = get_type_by_index_t<Index, Ts...>;
+        if constexpr (std::is_nothrow_constructible_v<T, Args...>) {
+            clear();
+            put<T>(std::forward<Args>(args)...);
+        } else if constexpr (std::is_nothrow_move_constructible_v<T>) {
+            T temporary(std::forward<Args>(args)...);
+            clear();
+            put<T>(std::move(temporary));
+        } else {
+            clear();
+            try {
+                put<T>(std::forward<Args>(args)...);
+            } catch (...) {
+                mark_valueless();
+                throw;
+            }
+        }
+        setIndex(Index);
+    }
 
-    size_t index_ = EMPTYINDEX;
-    VariadicUnion<Ts...> storage;
+    //same as copying or moving that into a fresh variant, through replace
+    template <typename Other>
+    void assignFrom(Other&& that) {
+        if (that.valueless_by_exception()) {
+            clear();
+            return;
+        }
+        visit_index<sizeof...(Ts)>([this, &that](auto index) {
+            constexpr size_t Index = decltype(index)::value;
+            replace<Index>(VariantAccess::get<Index>(std::forward<Other>(that)));
+        }, that.index());
+    }
 
 public:
+    VariantStorage() {
+        if constexpr (Layout::USE_NICHE) {
+            setIndex(EMPTYINDEX);
+        }
+    }
+
     size_t index() const {
-        return index_;
+        if constexpr (Layout::USE_NICHE) {
+            size_t niche = Layout::Niche::get(&storage);
+            if (niche == Layout::Niche::count)
+                return Layout::NICHE_OWNER;
+            if (niche == sizeof...(Ts) - 1)
+                return EMPTYINDEX;
+            return niche + (niche >= Layout::NICHE_OWNER);
+        } else {
+            return size_t(this->index_) - 1;
+        }
     }
 
     bool valueless_by_exception() const {
-        return index_ == EMPTYINDEX;
+        if constexpr (VariantTraits<Ts...>::NEVER_VALUELESS) {
+            return false;
+        } else {
+            return !holdsValue();
+        }
     }
 };
 
+
+//special members of Variant are stacked one per layer on top of the storage, each layer is left
+//implicit, and so trivial, when every alternative does that operation trivially
+template <bool Trivial, typename ... Ts>
+class VariantDestructor : public VariantStorage<Ts...> {
+public:
+    VariantDestructor() = default;
+    VariantDestructor(const VariantDestructor&) = default;
+    VariantDestructor(VariantDestructor&&) = default;
+    VariantDestructor& operator=(const VariantDestructor&) = default;
+    VariantDestructor& operator=(VariantDestructor&&) = default;
+
+    ~VariantDestructor() {
+        this->clear();
+    }
+};
+
+template <typename ... Ts>
+class VariantDestructor<true, Ts...> : public VariantStorage<Ts...> {};
+
+
+template <bool Trivial, typename ... Ts>
+class VariantCopyConstruct : public VariantDestructor<VariantTraits<Ts...>::TRIVIAL_DESTRUCTOR, Ts...> {
+public:
+    VariantCopyConstruct() = default;
+
+    VariantCopyConstruct(const VariantCopyConstruct& that) noexcept(VariantTraits<Ts...>::NOTHROW_COPY)
+            : VariantDestructor<VariantTraits<Ts...>::TRIVIAL_DESTRUCTOR, Ts...>() {
+        if (!that.valueless_by_exception()) {
+            this->constructFrom(that);
+        }
+    }
+
+    VariantCopyConstruct(VariantCopyConstruct&&) = default;
+    VariantCopyConstruct& operator=(const VariantCopyConstruct&) = default;
+    VariantCopyConstruct& operator=(VariantCopyConstruct&&) = default;
+};
+
+template <typename ... Ts>
+class VariantCopyConstruct<true, Ts...> : public VariantDestructor<VariantTraits<Ts...>::TRIVIAL_DESTRUCTOR, Ts...> {};
+
+
+template <bool Trivial, typename ... Ts>
+class VariantMoveConstruct : public VariantCopyConstruct<VariantTraits<Ts...>::TRIVIAL_COPY, Ts...> {
+public:
+    VariantMoveConstruct() = default;
+    VariantMoveConstruct(const VariantMoveConstruct&) = default;
+
+    VariantMoveConstruct(VariantMoveConstruct&& that) noexcept(VariantTraits<Ts...>::NOTHROW_MOVE)
+            : VariantCopyConstruct<VariantTraits<Ts...>::TRIVIAL_COPY, Ts...>() {
+        if (!that.valueless_by_exception()) {
+            this->constructFrom(std::move(that));
+        }
+    }
+
+    VariantMoveConstruct& operator=(const VariantMoveConstruct&) = default;
+    VariantMoveConstruct& operator=(VariantMoveConstruct&&) = default;
+};
+
+template <typename ... Ts>
+class VariantMoveConstruct<true, Ts...> : public VariantCopyConstruct<VariantTraits<Ts...>::TRIVIAL_COPY, Ts...> {};
+
+
+template <bool Trivial, typename ... Ts>
+class VariantCopyAssign : public VariantMoveConstruct<VariantTraits<Ts...>::TRIVIAL_MOVE, Ts...> {
+public:
+    VariantCopyAssign() = default;
+    VariantCopyAssign(const VariantCopyAssign&) = default;
+    VariantCopyAssign(VariantCopyAssign&&) = default;
+
+    VariantCopyAssign& operator=(const VariantCopyAssign& that) noexcept(VariantTraits<Ts...>::NOTHROW_COPY) {
+        if (this == &that)
+            return *this;
+
+        this->assignFrom(that);
+        return *this;
+    }
+
+    VariantCopyAssign& operator=(VariantCopyAssign&&) = default;
+};
+
+template <typename ... Ts>
+class VariantCopyAssign<true, Ts...> : public VariantMoveConstruct<VariantTraits<Ts...>::TRIVIAL_MOVE, Ts...> {};
+
+
+template <bool Trivial, typename ... Ts>
+class VariantMoveAssign : public VariantCopyAssign<VariantTraits<Ts...>::TRIVIAL_COPY_ASSIGN, Ts...> {
+public:
+    VariantMoveAssign() = default;
+    VariantMoveAssign(const VariantMoveAssign&) = default;
+    VariantMoveAssign(VariantMoveAssign&&) = default;
+    VariantMoveAssign& operator=(const VariantMoveAssign&) = default;
+
+    VariantMoveAssign& operator=(VariantMoveAssign&& that) noexcept(VariantTraits<Ts...>::NOTHROW_MOVE) {
+        if (this == &that)
+            return *this;
+
+        this->assignFrom(std::move(that));
+        return *this;
+    }
+};
+
+template <typename ... Ts>
+class VariantMoveAssign<true, Ts...> : public VariantCopyAssign<VariantTraits<Ts...>::TRIVIAL_COPY_ASSIGN, Ts...> {};
+
+template <typename ... Ts>
+using VariantBase = VariantMoveAssign<VariantTraits<Ts...>::TRIVIAL_MOVE_ASSIGN, Ts...>;
+
 template <typename T, typename ... Ts>
 class VariantAlternative {
     template <typename ... Types>
@@ -267,63 +668,28 @@ public:
     VariantAlternative(U&& value) {
         auto this_ptr = static_cast<Derived*>(this);
         try {
-            this_ptr->storage.template put<T>(std::forward<U>(value));
+            this_ptr->template put<T>(std::forward<U>(value));
         } catch (...) {
             this_ptr->mark_valueless();
             throw;
         }
-        this_ptr->index_ = Index;
+        this_ptr->setIndex(Index);
     }
 
     void constructDefault() {
         auto this_ptr = static_cast<Derived*>(this);
         try {
-            this_ptr->storage.template put<T>();
+            this_ptr->template put<T>();
         } catch (...) {
             this_ptr->mark_valueless();
             throw;
         }
-        this_ptr->index_ = Index;
+        this_ptr->setIndex(Index);
     }
-
-    void destroy() {
-        auto this_ptr = static_cast<Derived*>(this);
-        if (this_ptr->index_ == Index) {
-            this_ptr->storage.template destroy<T>();
-        }
-    }
-
-
-    void moveFrom(Derived&& variant) {
-        if (variant.index() == Index) {
-            auto this_ptr = static_cast<Derived*>(this);
-            try {
-                this_ptr->storage.template put<T>(get<T>(std::move(variant)));
-            } catch (...) {
-                this_ptr->mark_valueless();
-                throw;
-            }
-            this_ptr->index_ = Index;
-        }
-    }
-
-    void copyFrom(const Derived& variant) {
-        if (variant.index() == Index) {
-            auto this_ptr = static_cast<Derived*>(this);
-            try {
-                this_ptr->storage.template put<T>(get<T>(variant));
-            } catch (...) {
-                this_ptr->mark_valueless();
-                throw;
-            }
-            this_ptr->index_ = Index;
-        }
-    }
-
 };
 
 template <typename ... Ts>
-class Variant : private VariantStorage<Ts...>, private VariantAlternative<Ts, Ts...> ... {
+class Variant : private VariantBase<Ts...>, private VariantAlternative<Ts, Ts...> ... {
     template <typename ... Types>
     friend
     class VariantStorage;
@@ -332,24 +698,14 @@ class Variant : private VariantStorage<Ts...>, private VariantAlternative<Ts, Ts
     friend
     class VariantAlternative;
 
-    template <typename T, typename ... Types>
-    friend T& get(Variant<Types...>&);
+    friend struct VariantAccess;
 
-    template <typename T, typename ... Types>
-    friend const T& get(const Variant<Types...>&);
-
-    template <typename T, typename ... Types>
-    friend T&& get(Variant<Types...>&&);
+    friend struct VariantCodec;
 
+    struct Valueless {};
 
-    void clear() {
-        (::VariantAlternative<Ts, Ts...>::destroy(), ...);
-        this->mark_valueless();
-    }
-
-    void mark_valueless() {
-        this->index_ = VariantStorage<Ts...>::EMPTYINDEX;
-    }
+    //only for a decoder that is about to construct an alternative in place
+    explicit Variant(Valueless) {}
 
 public:
     using VariantAlternative<Ts, Ts...>::VariantAlternative...;
@@ -364,39 +720,21 @@ public:
     template <typename T, typename U, typename ... Args>
     T& emplace(std::initializer_list<U> InList, Args&& ... args) {
         //initializer list type can not be deduced, so extra version of emplace needed
-        clear();
         static_assert(count_occurrences_of_type_v<T, Ts...> == 1 &&
                       std::is_constructible_v<T, std::initializer_list<U>, Args...>,
                       "incorrect usage of emplace");
 
-        try {
-            this->storage.template put<T>(InList, std::forward<Args>(args)...);
-        } catch (...) {
-            this->mark_valueless();
-            throw;
-        }
-
-        this->index_ = get_index_by_type_v<T, Ts...>;
-
+        this->template replace<get_index_by_type_v<T, Ts...>>(InList, std::forward<Args>(args)...);
         return get<T>(*this);
     }
 
     template <typename T, typename ... Args>
     T& emplace(Args&& ... args) {
-        clear();
         static_assert(count_occurrences_of_type_v<T, Ts...> == 1 &&
                       std::is_constructible_v<T, Args...>,
                       "incorrect usage of emplace");
 
-        try {
-            this->storage.template put<T>(std::forward<Args>(args)...);
-        } catch (...) {
-            this->mark_valueless();
-            throw;
-        }
-
-        this->index_ = get_index_by_type_v<T, Ts...>;
-
+        this->template replace<get_index_by_type_v<T, Ts...>>(std::forward<Args>(args)...);
         return get<T>(*this);
     }
 
@@ -405,71 +743,382 @@ public:
         return emplace<get_type_by_index_t<Index, Ts...>>(std::forward<Args>(args)...);
     }
 
-    Variant(Variant&& that) {
-        if (that.valueless_by_exception()) {
-            this->mark_valueless();
-            return;
+    Variant(const Variant&) = default;
+    Variant(Variant&&) = default;
+    Variant& operator=(const Variant&) = default;
+    Variant& operator=(Variant&&) = default;
+    ~Variant() = default;
+
+    template <typename T, typename U = best_conversion_t<T, Ts...>>
+    Variant& operator=(T&& value) {
+        static_assert(count_occurrences_of_type_v<U, Ts...> == 1, "ambiguity...");
+        if(holds_alternative<U>(*this)) {
+            get<U>(*this) = std::forward<T>(value);
+            return *this;
         }
 
-        (::VariantAlternative<Ts, Ts...>::moveFrom(std::move(that)), ...);
+        this->template replace<get_index_by_type_v<U, Ts...>>(std::forward<T>(value));
+        return *this;
     }
+};
 
-    Variant(const Variant& that) : VariantStorage<Ts...>(), VariantAlternative<Ts, Ts...>()... {
-        if (that.valueless_by_exception()) {
-            this->mark_valueless();
-            return;
-        }
 
-        (::VariantAlternative<Ts, Ts...>::copyFrom(std::move(that)), ...);
+//  variant
+//------------------------------------------------------------------------------------------------
+//  variant vector
+
+//a contiguous run of one alternative's values inside a VariantVector
+template <typename T>
+class VariantVectorRange {
+    T* first;
+    T* last;
+
+public:
+    VariantVectorRange(T* first, T* last) : first(first), last(last) {}
+
+    T* begin() const {
+        return first;
     }
 
-    Variant& operator=(const Variant& that) {
-        clear();
-        if (that.valueless_by_exception()) {
-            this->mark_valueless();
-            return *this;
-        }
+    T* end() const {
+        return last;
+    }
 
-        (::VariantAlternative<Ts, Ts...>::copyFrom(that), ...);
+    size_t size() const {
+        return last - first;
+    }
 
-        return *this;
+    bool empty() const {
+        return first == last;
     }
 
-    Variant& operator=(Variant&& that) noexcept {
-        clear();
-        if (that.valueless_by_exception()) {
-            this->mark_valueless();
-            return *this;
+    T& operator[](size_t i) const {
+        return first[i];
+    }
+};
+
+//stands in for std::vector<bool>, whose packed bits have no data() and no bool& to hand out
+class VariantVectorBoolArray {
+    std::unique_ptr<bool[]> values;
+    size_t sz = 0;
+    size_t cap = 0;
+
+public:
+    VariantVectorBoolArray() = default;
+
+    VariantVectorBoolArray(const VariantVectorBoolArray& that) : values(that.sz ? new bool[that.sz] : nullptr),
+                                                                 sz(that.sz), cap(that.sz) {
+        std::copy(that.values.get(), that.values.get() + sz, values.get());
+    }
+
+    VariantVectorBoolArray(VariantVectorBoolArray&& that) noexcept : values(std::move(that.values)),
+                                                                     sz(std::exchange(that.sz, 0)),
+                                                                     cap(std::exchange(that.cap, 0)) {}
+
+    VariantVectorBoolArray& operator=(const VariantVectorBoolArray& that) {
+        if (this != &that) {
+            VariantVectorBoolArray tmp(that);
+            *this = std::move(tmp);
         }
+        return *this;
+    }
 
-        (::VariantAlternative<Ts, Ts...>::moveFrom(std::move(that)), ...);
+    VariantVectorBoolArray& operator=(VariantVectorBoolArray&& that) noexcept {
+        values = std::move(that.values);
+        sz = std::exchange(that.sz, 0);
+        cap = std::exchange(that.cap, 0);
         return *this;
+    }
 
+    template <typename ... Args>
+    bool& emplace_back(Args&& ... args) {
+        bool value(std::forward<Args>(args)...);
+        if (sz == cap) {
+            size_t newCap = cap ? cap * 2 : 8;
+            std::unique_ptr<bool[]> newValues(new bool[newCap]);
+            std::copy(values.get(), values.get() + sz, newValues.get());
+            values = std::move(newValues);
+            cap = newCap;
+        }
+        values[sz] = value;
+        return values[sz++];
     }
 
+    bool& back() {
+        return values[sz - 1];
+    }
 
-    template <typename T, typename U = best_conversion_t<T, Ts...>>
-    Variant& operator=(T&& value) {
-        static_assert(count_occurrences_of_type_v<U, Ts...> == 1, "ambiguity...");
-        if(holds_alternative<U>(*this)) {
-            get<U>(*this) = std::forward<T>(value);
-            return *this;
-        }
+    bool& operator[](size_t i) {
+        return values[i];
+    }
+
+    const bool& operator[](size_t i) const {
+        return values[i];
+    }
+
+    bool* data() {
+        return values.get();
+    }
+
+    const bool* data() const {
+        return values.get();
+    }
+
+    size_t size() const {
+        return sz;
+    }
+
+    void clear() {
+        sz = 0;
+    }
+};
+
+template <typename T>
+using variant_vector_array_t = std::conditional_t<std::is_same_v<T, bool>,
+                                                  VariantVectorBoolArray, std::vector<T>>;
 
-        clear();
+//a sequence of Variant<Ts...> stored as one array per alternative plus a stream of one-byte (for up to 255
+//alternatives) tags giving the order, so no element pays for the padding of the largest alternative
+//and a scan over a single type touches only that type's values
+template <typename ... Ts>
+class VariantVector {
+    using Tag = variant_index_t<sizeof...(Ts)>;
+
+    std::tuple<variant_vector_array_t<Ts>...> arrays;
+    std::vector<Tag> tags;
+
+    template <size_t Index, typename ... Args>
+    void put(Args&& ... args) {
+        tags.push_back(static_cast<Tag>(Index));
         try {
-            this->storage.template put<U>(std::forward<T>(value));
-            this->index_ = get_index_by_type_v<U, Ts...>;
+            std::get<Index>(arrays).emplace_back(std::forward<Args>(args)...);
         } catch (...) {
-            this->mark_valueless();
+            tags.pop_back();
             throw;
         }
+    }
 
-        return *this;
+    template <typename V>
+    void putVariant(V&& variant) {
+        if (variant.valueless_by_exception()) {
+            throw std::logic_error("storing a valueless variant");
+        }
+        visit_index<sizeof...(Ts)>([this, &variant](auto index) {
+            constexpr size_t Index = decltype(index)::value;
+            put<Index>(VariantAccess::get<Index>(std::forward<V>(variant)));
+        }, variant.index());
+    }
+
+    //walks the tags keeping a cursor into every array, so the i-th element of a type is found without a search
+    template <typename Self, typename Visitor>
+    static void visitOrdered(Self& self, Visitor&& visitor) {
+        size_t cursors[sizeof...(Ts)] = {};
+        for (Tag tag: self.tags) {
+            visit_index<sizeof...(Ts)>([&self, &visitor, &cursors](auto index) {
+                constexpr size_t Index = decltype(index)::value;
+                std::invoke(visitor, std::get<Index>(self.arrays)[cursors[Index]++]);
+            }, tag);
+        }
     }
 
+public:
+    VariantVector() = default;
+
+    size_t size() const {
+        return tags.size();
+    }
+
+    bool empty() const {
+        return tags.empty();
+    }
+
+    //index of the alternative held by the element at position i
+    size_t index(size_t i) const {
+        return tags[i];
+    }
+
+    void reserve(size_t n) {
+        tags.reserve(n);
+    }
+
+    void clear() {
+        tags.clear();
+        std::apply([](auto& ... array) { (array.clear(), ...); }, arrays);
+    }
+
+    void push_back(const Variant<Ts...>& variant) {
+        putVariant(variant);
+    }
+
+    void push_back(Variant<Ts...>&& variant) {
+        putVariant(std::move(variant));
+    }
+
+    template <typename T, typename ... Args>
+    T& emplace_back(Args&& ... args) {
+        static_assert(count_occurrences_of_type_v<T, Ts...> == 1 &&
+                      std::is_constructible_v<T, Args...>,
+                      "incorrect usage of emplace_back");
+
+        constexpr size_t Index = get_index_by_type_v<T, Ts...>;
+        put<Index>(std::forward<Args>(args)...);
+        return std::get<Index>(arrays).back();
+    }
+
+    template <size_t Index, typename ... Args>
+    auto& emplace_back(Args&& ... args) {
+        static_assert(Index < sizeof...(Ts), "index out of range");
+
+        put<Index>(std::forward<Args>(args)...);
+        return std::get<Index>(arrays).back();
+    }
 
-    ~Variant() {
-        clear();
+    template <size_t Index>
+    auto alternative() {
+        auto& array = std::get<Index>(arrays);
+        return VariantVectorRange(array.data(), array.data() + array.size());
+    }
+
+    template <size_t Index>
+    auto alternative() const {
+        auto& array = std::get<Index>(arrays);
+        return VariantVectorRange(array.data(), array.data() + array.size());
+    }
+
+    //all values of type T in insertion order
+    template <typename T>
+    auto alternative() {
+        static_assert(count_occurrences_of_type_v<T, Ts...> == 1, "ambiguity...");
+        return alternative<get_index_by_type_v<T, Ts...>>();
+    }
+
+    template <typename T>
+    auto alternative() const {
+        static_assert(count_occurrences_of_type_v<T, Ts...> == 1, "ambiguity...");
+        return alternative<get_index_by_type_v<T, Ts...>>();
+    }
+
+    template <typename T>
+    size_t count() const {
+        return alternative<T>().size();
+    }
+
+    //calls visitor on every element in insertion order with the value of its alternative
+    template <typename Visitor>
+    void visit(Visitor&& visitor) {
+        visitOrdered(*this, visitor);
+    }
+
+    template <typename Visitor>
+    void visit(Visitor&& visitor) const {
+        visitOrdered(*this, visitor);
+    }
+};
+
+
+//  variant vector
+//------------------------------------------------------------------------------------------------
+//  serialization
+
+//how one alternative goes on the wire: encode(value, out) writes size(value) bytes and returns their end,
+//decode(in, end, storage) constructs the value at storage and returns where it stopped reading,
+//on malformed input it throws with nothing constructed; specialize it for types that are not trivially copyable
+template <typename T, typename = void>
+struct variant_codec;
+
+template <typename T>
+struct variant_codec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static size_t size(const T&) {
+        return sizeof(T);
+    }
+
+    static char* encode(const T& value, char* out) {
+        std::memcpy(out, &value, sizeof(T));
+        return out + sizeof(T);
+    }
+
+    static const char* decode(const char* in, const char* end, void* storage) {
+        if (size_t(end - in) < sizeof(T)) {
+            throw std::logic_error("truncated variant message");
+        }
+        //bytes that a type reserves as its niche are not a value of it, and written into a niche-packed
+        //variant they would read back as another index, so they are rejected before anything is stored
+        if constexpr (variant_niche<T>::count > 0) {
+            alignas(T) unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, in, sizeof(T));
+            if (variant_niche<T>::get(bytes) != variant_niche<T>::count) {
+                throw std::logic_error("invalid variant payload");
+            }
+        }
+        std::memcpy(storage, in, sizeof(T));
+        return in + sizeof(T);
+    }
+};
+
+//a message is the index of the alternative, one byte for up to 255 of them, followed by its payload
+struct VariantCodec {
+    template <typename ... Ts>
+    using Tag = variant_index_t<sizeof...(Ts)>;
+
+    template <typename ... Ts>
+    static size_t size(const Variant<Ts...>& variant) {
+        return sizeof(Tag<Ts...>) + visit([](const auto& value) {
+            return variant_codec<std::decay_t<decltype(value)>>::size(value);
+        }, variant);
+    }
+
+    template <typename ... Ts>
+    static char* encode(const Variant<Ts...>& variant, char* out) {
+        if (variant.valueless_by_exception()) {
+            throw std::logic_error("encoding a valueless variant");
+        }
+        Tag<Ts...> tag = static_cast<Tag<Ts...>>(variant.index());
+        std::memcpy(out, &tag, sizeof(tag));
+        out += sizeof(tag);
+        return visit([out](const auto& value) {
+            return variant_codec<std::decay_t<decltype(value)>>::encode(value, out);
+        }, variant);
+    }
+
+    //the payload is decoded straight into the storage of the returned variant, which is never valueless:
+    //on malformed input nothing is returned at all
+    template <typename ... Ts>
+    static Variant<Ts...> decode(identity<Variant<Ts...>>, const char*& in, const char* end) {
+        Tag<Ts...> tag;
+        if (size_t(end - in) < sizeof(tag)) {
+            throw std::logic_error("truncated variant message");
+        }
+        std::memcpy(&tag, in, sizeof(tag));
+        if (tag >= sizeof...(Ts)) {
+            throw std::logic_error("unknown variant alternative");
+        }
+
+        Variant<Ts...> result{typename Variant<Ts...>::Valueless()};
+        const char* payload = in + sizeof(tag);
+        visit_index<sizeof...(Ts)>([&result, &payload, end](auto index) {
+            using T = get_type_by_index_t<decltype(index)::value, Ts...>;
+            payload = variant_codec<std::remove_cv_t<T>>::decode(payload, end, &result.storage);
+        }, tag);
+        result.setIndex(tag);
+
+        in = payload;
+        return result;
     }
 };
+
+template <typename ... Ts>
+size_t encoded_size(const Variant<Ts...>& variant) {
+    return VariantCodec::size(variant);
+}
+
+//writes encoded_size(variant) bytes to out and returns their end
+template <typename ... Ts>
+char* encode_variant(const Variant<Ts...>& variant, char* out) {
+    return VariantCodec::encode(variant, out);
+}
+
+//reads one message of type V = Variant<Ts...> from [in, end) and moves in past it
+template <typename V>
+V decode_variant(const char*& in, const char* end) {
+    return VariantCodec::decode(identity<V>(), in, end);
+}